@@ -31,6 +31,9 @@
 
 #include <mcontainer.h>
 
+#include "payload.h"
+#include "workload.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -42,36 +45,129 @@
 #include <sys/mman.h>
 #include <sys/syscall.h>
 
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options] number_of_objects max_size_of_objects number_of_processes number_of_containers\n"
+                    "  -d seq|uniform|zipf|hotspot  object id distribution (default seq)\n"
+                    "  -t theta                     zipfian skew, 0 < theta < 1 (default 0.99)\n"
+                    "  -H fraction:probability      hotspot set size and access probability (default 0.2:0.8)\n"
+                    "  -w ratio                     fraction of operations that write (default 1.0)\n"
+                    "  -s fixed|uniform|exp         payload size distribution (default fixed)\n"
+                    "  -n ops                       operations per process (default number_of_objects)\n"
+                    "  -r ops_per_sec               open-loop target rate per process (default closed-loop)\n"
+                    "  -c                           cache one mapping per object instead of mapping per operation\n",
+            prog);
+    exit(1);
+}
+
 int main(int argc, char *argv[])
 {
     // variable initialization
     int i = 0; 
     int number_of_processes = 1, number_of_objects = 1024, max_size_of_objects = 8192, number_of_containers = 1;
-    int a, j, cid, size, stat, child_pid, devfd, max_size_of_objects_with_buffer;
+    int cid, stat, child_pid = 0, devfd, opt, oid, size, cache_mappings = 0;
+    long number_of_operations = -1, op;
     char filename[256];
-    char *mapped_data, *data;
-    unsigned long long msec_time;
+    char *mapped_data, **mappings = NULL;
+    unsigned long long seed, *words;
+    volatile unsigned long long checksum = 0;
+    uint64_t start_ns, due_ns, end_ns;
     FILE *fp;
     struct timeval current_time;
+    struct workload w;
+    struct workload_stats stats;
     pid_t *pid; 
 
+    memset(&w, 0, sizeof(w));
+    memset(&stats, 0, sizeof(stats));
+    w.dist = DIST_SEQUENTIAL;
+    w.size_dist = SIZE_FIXED;
+    w.write_ratio = 1.0;
+    w.zipf_theta = 0.99;
+    w.hot_fraction = 0.2;
+    w.hot_probability = 0.8;
+
     // takes arguments from command line interface.
-    if (argc < 4)
+    while ((opt = getopt(argc, argv, "d:t:H:w:s:n:r:c")) != -1)
     {
-        fprintf(stderr, "Usage: %s number_of_objects max_size_of_objects number_of_processes number_of_containers\n", argv[0]);
-        exit(1);
+        switch (opt)
+        {
+        case 'd':
+            if (!strcmp(optarg, "seq"))
+                w.dist = DIST_SEQUENTIAL;
+            else if (!strcmp(optarg, "uniform"))
+                w.dist = DIST_UNIFORM;
+            else if (!strcmp(optarg, "zipf"))
+                w.dist = DIST_ZIPFIAN;
+            else if (!strcmp(optarg, "hotspot"))
+                w.dist = DIST_HOTSPOT;
+            else
+                usage(argv[0]);
+            break;
+        case 't':
+            w.zipf_theta = atof(optarg);
+            break;
+        case 'H':
+            if (sscanf(optarg, "%lf:%lf", &w.hot_fraction, &w.hot_probability) != 2)
+                usage(argv[0]);
+            break;
+        case 'w':
+            w.write_ratio = atof(optarg);
+            break;
+        case 's':
+            if (!strcmp(optarg, "fixed"))
+                w.size_dist = SIZE_FIXED;
+            else if (!strcmp(optarg, "uniform"))
+                w.size_dist = SIZE_UNIFORM;
+            else if (!strcmp(optarg, "exp"))
+                w.size_dist = SIZE_EXPONENTIAL;
+            else
+                usage(argv[0]);
+            break;
+        case 'n':
+            number_of_operations = atol(optarg);
+            break;
+        case 'r':
+            w.rate = atof(optarg);
+            break;
+        case 'c':
+            cache_mappings = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (argc - optind < 4)
+    {
+        usage(argv[0]);
     }
 
-    number_of_objects = atoi(argv[1]);
-    max_size_of_objects = atoi(argv[2]);
-    number_of_processes = atoi(argv[3]);
-    number_of_containers = atoi(argv[4]);
+    number_of_objects = atoi(argv[optind]);
+    max_size_of_objects = atoi(argv[optind + 1]);
+    number_of_processes = atoi(argv[optind + 2]);
+    number_of_containers = atoi(argv[optind + 3]);
+
+    if (w.dist == DIST_ZIPFIAN && (w.zipf_theta <= 0 || w.zipf_theta >= 1))
+    {
+        fprintf(stderr, "zipfian theta must be in (0, 1)\n");
+        exit(1);
+    }
+    if (number_of_operations < 0)
+    {
+        number_of_operations = number_of_objects;
+    }
+    w.number_of_objects = number_of_objects;
+    w.max_size_of_objects = max_size_of_objects;
 
-    max_size_of_objects_with_buffer = max_size_of_objects + 100;
     pid = (pid_t *) calloc(number_of_processes - 1, sizeof(pid_t));
+    if (cache_mappings)
+    {
+        mappings = (char **) calloc(number_of_objects, sizeof(char *));
+    }
 
     // open the kernel module to use it
-    devfd = open("/dev/mcontainer", O_RDWR);
+    devfd = mcontainer_init(MCONTAINER_BACKEND_DEFAULT);
     if (devfd < 0)
     {
         fprintf(stderr, "Device open failed");
@@ -92,10 +188,9 @@ int main(int argc, char *argv[])
         }
     }
 
-    data = (char *) malloc(max_size_of_objects_with_buffer * sizeof(char));
-
     // create the log file
     srand((int)time(NULL) + (int)getpid());
+    workload_init(&w, ((unsigned long long)rand() << 31) ^ (unsigned long long)getpid());
     sprintf(filename, "mcontainer.%d.log", (int)getpid());
     fp = fopen(filename, "w");
 
@@ -103,47 +198,95 @@ int main(int argc, char *argv[])
     cid = getpid() % number_of_containers;
     mcontainer_create(devfd, cid);
 
-    // Writing to objects
-    for (i = 0; i < number_of_objects; i++)
+    // Run the workload: each operation locks, maps and then reads or writes one object.
+    start_ns = workload_now_ns();
+    for (op = 0; op < number_of_operations; op++)
     {
-        mcontainer_lock(devfd, i);
-        mapped_data = (char *)mcontainer_alloc(devfd, i, max_size_of_objects);
+        due_ns = workload_pace(&w, start_ns, op);
+        oid = workload_next_oid(&w);
+
+        mcontainer_lock(devfd, oid);
+        if (mappings && mappings[oid])
+        {
+            mapped_data = mappings[oid];
+        }
+        else
+        {
+            mapped_data = (char *)mcontainer_alloc(devfd, oid, max_size_of_objects);
+        }
 
         // error handling
-        if (!mapped_data)
+        if (!mapped_data || mapped_data == MAP_FAILED)
         {
             fprintf(stderr, "Failed in mcontainer_alloc()\n");
             exit(1);
         }
 
-        // generate a random number to write into the object.
-        a = rand() + 1;
+        if (workload_next_is_write(&w))
+        {
+            // generate a random non-zero seed; the payload is derived from it.
+            seed = workload_rand(&w) | 1;
+            size = workload_next_size(&w);
+
+            // starts to write the data to that address.
+            gettimeofday(&current_time, NULL);
+            payload_fill(mapped_data, size, seed);
+
+            // prints out the seed into the log, validate regenerates the payload.
+            fprintf(fp, "S\t%d\t%d\t%ld\t%d\t%d\t%llx\n", getpid(), cid, current_time.tv_sec * 1000000 + current_time.tv_usec, oid, size, seed);
+            stats.writes++;
+        }
+        else
+        {
+            words = (unsigned long long *)mapped_data;
+            for (i = 0; i < max_size_of_objects / (int)sizeof(*words); i++)
+            {
+                checksum += words[i];
+            }
+            stats.reads++;
+        }
+        mcontainer_unlock(devfd, oid);
 
-        // starts to write the data to that address.
-        gettimeofday(&current_time, NULL);
-        for (j = 0; j < max_size_of_objects_with_buffer - 10; j = strlen(data))
+        if (mappings)
+        {
+            mappings[oid] = mapped_data;
+        }
+        else
         {
-            sprintf(data, "%s%d", data, a);
+            mcontainer_unmap(devfd, mapped_data, max_size_of_objects);
         }
-        strncpy(mapped_data, data, max_size_of_objects-1);
-        mapped_data[max_size_of_objects-1] = '\0';
-        
-        // prints out the result into the log
-        fprintf(fp, "S\t%d\t%d\t%ld\t%d\t%d\t%s\n", getpid(), cid, current_time.tv_sec * 1000000 + current_time.tv_usec, i, max_size_of_objects, mapped_data);
-        mcontainer_unlock(devfd, i);
-        memset(data, 0, max_size_of_objects_with_buffer);
+        end_ns = workload_now_ns();
+        workload_record(&stats, end_ns - due_ns);
     }
+    end_ns = workload_now_ns();
+
+    fprintf(stderr, "pid %d cid %d: %llu reads %llu writes in %.3f s, %.0f ops/s, latency mean %.1f us p50 <%.1f us p99 <%.1f us max %.1f us\n",
+            getpid(), cid, (unsigned long long)stats.reads, (unsigned long long)stats.writes,
+            (end_ns - start_ns) / 1e9, number_of_operations * 1e9 / (end_ns - start_ns + 1),
+            number_of_operations ? stats.total_ns / 1e3 / number_of_operations : 0.0,
+            workload_percentile(&stats, 0.50) / 1e3, workload_percentile(&stats, 0.99) / 1e3, stats.max_ns / 1e3);
 
     // try delete something
     i = rand() % number_of_objects;
     mcontainer_lock(devfd, i);
     gettimeofday(&current_time, NULL);
     mcontainer_free(devfd, i);
-    fprintf(fp, "D\t%d\t%d\t%ld\t%d\t%d\t%s\n", getpid(), cid, current_time.tv_sec * 1000000 + current_time.tv_usec, i, max_size_of_objects, "delete_an_object");
+    fprintf(fp, "D\t%d\t%d\t%ld\t%d\t%d\t%llx\n", getpid(), cid, current_time.tv_sec * 1000000 + current_time.tv_usec, i, max_size_of_objects, 0ULL);
     mcontainer_unlock(devfd, i);
     
     
     // done with works, cleanup and wait for other processes.
+    if (mappings)
+    {
+        for (i = 0; i < number_of_objects; i++)
+        {
+            if (mappings[i])
+            {
+                mcontainer_unmap(devfd, mappings[i], max_size_of_objects);
+            }
+        }
+        free(mappings);
+    }
     mcontainer_delete(devfd);
     close(devfd);
     if (child_pid != 0)
@@ -154,6 +297,5 @@ int main(int argc, char *argv[])
         }
     }
     free(pid);
-    free(data);
     return 0;
 }
@@ -0,0 +1,118 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Description:
+//     Checking that the Lock of a Killed Holder Can Be Taken
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <mcontainer.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define LOCK_TIMEOUT_NS 5000000000ULL
+
+int main(int argc, char *argv[])
+{
+    int i, devfd, ready[2], error = 0, number_of_rounds = 1;
+    pid_t child_pid;
+    __u64 seq;
+    char c;
+
+    // takes arguments from command line interface.
+    if (argc > 1)
+    {
+        number_of_rounds = atoi(argv[1]);
+    }
+
+    devfd = mcontainer_init(MCONTAINER_BACKEND_DEFAULT);
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+
+    // a reader waiting on the dead holder's write would hang: bound the run
+    alarm(60);
+    for (i = 0; i < number_of_rounds && !error; i++)
+    {
+        if (pipe(ready) < 0)
+        {
+            perror("pipe");
+            exit(1);
+        }
+        child_pid = fork();
+        if (child_pid == 0)
+        {
+            // the child takes the lock and is killed holding it
+            mcontainer_create(devfd, 0);
+            if (mcontainer_lock(devfd, 0) < 0)
+            {
+                _exit(1);
+            }
+            c = 0;
+            write(ready[1], &c, 1);
+            for (;;)
+            {
+                pause();
+            }
+        }
+        close(ready[1]);
+        if (read(ready[0], &c, 1) != 1)
+        {
+            fprintf(stderr, "Round %d: the holder could not take the lock\n", i);
+            exit(1);
+        }
+        close(ready[0]);
+
+        if (mcontainer_trylock(devfd, 0) == 0 || errno != EBUSY)
+        {
+            fprintf(stderr, "Round %d: the lock was taken while held\n", i);
+            error = 1;
+        }
+        kill(child_pid, SIGKILL);
+        waitpid(child_pid, NULL, 0);
+
+        if (mcontainer_lock_timeout(devfd, 0, LOCK_TIMEOUT_NS) < 0)
+        {
+            fprintf(stderr, "Round %d: the lock of the killed holder was not released: %s\n", i,
+                    errno == ETIMEDOUT ? "timed out" : "failed");
+            error = 1;
+            continue;
+        }
+        mcontainer_unlock(devfd, 0);
+        mcontainer_read_begin(devfd, 0, &seq);
+        if (mcontainer_read_retry(devfd, 0, seq))
+        {
+            fprintf(stderr, "Round %d: readers still see a writer inside\n", i);
+            error = 1;
+        }
+    }
+    mcontainer_delete(devfd);
+    close(devfd);
+
+    printf(error ? "Fail\n" : "Pass\n");
+    return error;
+}
@@ -0,0 +1,140 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Description:
+//     Checking that a Failed Multi-Object Lock Holds None of Its Objects
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <mcontainer.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define NUMBER_OF_OIDS  4
+#define HELD_OID        3
+#define SHORT_TIMEOUT_NS 10000000ULL
+#define LOCK_TIMEOUT_NS 5000000000ULL
+
+static const __u64 oids[NUMBER_OF_OIDS] = {1, 2, 3, 4};
+
+// every oid but the one of the holder can be taken, so the set was let go
+static int holds_none(int devfd, const char *what)
+{
+    int i, error = 0;
+
+    for (i = 0; i < NUMBER_OF_OIDS; i++)
+    {
+        if (oids[i] == HELD_OID)
+        {
+            continue;
+        }
+        if (mcontainer_trylock(devfd, oids[i]) < 0)
+        {
+            fprintf(stderr, "%s: object %llu was not released: %s\n", what, (unsigned long long)oids[i],
+                    errno == EDEADLK ? "still held by the caller" : "held");
+            error = 1;
+            continue;
+        }
+        mcontainer_unlock(devfd, oids[i]);
+    }
+    return error;
+}
+
+int main(void)
+{
+    int devfd, ready[2], error = 0;
+    pid_t child_pid;
+    char c;
+
+    devfd = mcontainer_init(MCONTAINER_BACKEND_DEFAULT);
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+    if (pipe(ready) < 0)
+    {
+        perror("pipe");
+        exit(1);
+    }
+
+    // a lock_many waiting on the held object would hang: bound the run
+    alarm(60);
+    child_pid = fork();
+    if (child_pid == 0)
+    {
+        // the child holds one object of the set until it is killed
+        mcontainer_create(devfd, 0);
+        if (mcontainer_lock(devfd, HELD_OID) < 0)
+        {
+            _exit(1);
+        }
+        c = 0;
+        write(ready[1], &c, 1);
+        for (;;)
+        {
+            pause();
+        }
+    }
+    close(ready[1]);
+    if (read(ready[0], &c, 1) != 1)
+    {
+        fprintf(stderr, "The holder could not take the lock\n");
+        exit(1);
+    }
+    close(ready[0]);
+
+    if (mcontainer_lock_many_timeout(devfd, oids, NUMBER_OF_OIDS, 0) == 0 || errno != EBUSY)
+    {
+        fprintf(stderr, "Trying the set: taken while an object was held\n");
+        error = 1;
+    }
+    error |= holds_none(devfd, "Trying the set");
+
+    if (mcontainer_lock_many_timeout(devfd, oids, NUMBER_OF_OIDS, SHORT_TIMEOUT_NS) == 0 || errno != ETIMEDOUT)
+    {
+        fprintf(stderr, "Waiting for the set: did not time out\n");
+        error = 1;
+    }
+    error |= holds_none(devfd, "Waiting for the set");
+
+    kill(child_pid, SIGKILL);
+    waitpid(child_pid, NULL, 0);
+    if (mcontainer_lock_many_timeout(devfd, oids, NUMBER_OF_OIDS, LOCK_TIMEOUT_NS) < 0)
+    {
+        fprintf(stderr, "The set was not taken once its holder was gone\n");
+        error = 1;
+    }
+    else if (mcontainer_unlock_many(devfd, oids, NUMBER_OF_OIDS) < 0)
+    {
+        fprintf(stderr, "The set could not be unlocked\n");
+        error = 1;
+    }
+    mcontainer_delete(devfd);
+    close(devfd);
+
+    printf(error ? "Fail\n" : "Pass\n");
+    return error;
+}
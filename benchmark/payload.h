@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Description:
+//     Deterministic Payload Generator shared by Benchmark and Validate
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * splitmix64 finalizer: every output word only depends on the seed and its
+ * position, so a payload can be regenerated from the seed alone.
+ */
+static inline uint64_t payload_word(uint64_t seed, uint64_t index)
+{
+    uint64_t z = seed + (index + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Fill size bytes at dst with the payload derived from seed. The loop has
+ * no carried dependency, so it runs at memory bandwidth on mapped objects.
+ */
+static inline void payload_fill(void *dst, size_t size, uint64_t seed)
+{
+    unsigned char *p = (unsigned char *)dst;
+    size_t words = size / sizeof(uint64_t);
+    size_t i;
+    uint64_t w;
+
+    for (i = 0; i < words; i++)
+    {
+        w = payload_word(seed, i);
+        memcpy(p + i * sizeof(uint64_t), &w, sizeof(uint64_t));
+    }
+    if (size % sizeof(uint64_t))
+    {
+        w = payload_word(seed, words);
+        memcpy(p + words * sizeof(uint64_t), &w, size % sizeof(uint64_t));
+    }
+}
+
+#endif
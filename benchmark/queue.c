@@ -0,0 +1,261 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Description:
+//     Cross-Process Throughput of Memory Container Queues
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <mcontainer.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define QUEUE_CID      0
+#define QUEUE_OID      0
+#define QUEUE_CAPACITY 1024
+
+struct message
+{
+    unsigned long long index;
+    unsigned long long producer;
+};
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-m] number_of_messages [number_of_producers number_of_consumers]\n", name);
+    fprintf(stderr, "  -m  multi-producer multi-consumer queue (default: single-producer single-consumer)\n");
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// a tally may come in more than one piece
+static int read_all(int fd, void *buf, size_t size)
+{
+    ssize_t n;
+
+    while (size > 0)
+    {
+        n = read(fd, buf, size);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        buf = (char *)buf + n;
+        size -= n;
+    }
+    return 0;
+}
+
+static struct mcontainer_queue *open_queue(int *devfd, int flags)
+{
+    struct mcontainer_queue *queue;
+
+    *devfd = mcontainer_open(MCONTAINER_BACKEND_DEFAULT, QUEUE_CID);
+    if (*devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    queue = mcontainer_queue_open(*devfd, QUEUE_OID, QUEUE_CAPACITY, sizeof(struct message), flags);
+    if (!queue)
+    {
+        perror("mcontainer_queue_open");
+        exit(1);
+    }
+    return queue;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, j, opt, devfd, tallies[2], stat, error = 0;
+    int flags = MCONTAINER_QUEUE_SPSC, number_of_producers = 1, number_of_consumers = 1;
+    long number_of_messages, per_producer, per_consumer, n;
+    unsigned long long *counts, *sums, *total_counts, *total_sums;
+    struct mcontainer_queue *queue;
+    struct message m;
+    double start, elapsed;
+
+    // takes arguments from command line interface.
+    while ((opt = getopt(argc, argv, "m")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            flags = MCONTAINER_QUEUE_MPMC;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1 && argc - optind != 3)
+    {
+        usage(argv[0]);
+    }
+    number_of_messages = atol(argv[optind]);
+    if (argc - optind == 3)
+    {
+        number_of_producers = atoi(argv[optind + 1]);
+        number_of_consumers = atoi(argv[optind + 2]);
+    }
+    if (number_of_messages <= 0 || number_of_producers <= 0 || number_of_consumers <= 0 ||
+        (flags == MCONTAINER_QUEUE_SPSC && (number_of_producers != 1 || number_of_consumers != 1)))
+    {
+        usage(argv[0]);
+    }
+    // every task moves the same number of messages
+    per_producer = number_of_messages / number_of_producers;
+    per_consumer = per_producer * number_of_producers / number_of_consumers;
+    if (per_consumer * number_of_consumers != per_producer * number_of_producers)
+    {
+        fprintf(stderr, "number_of_messages has to split evenly over producers and over consumers\n");
+        exit(1);
+    }
+
+    // per producer, the number and the sum of the indices a consumer got
+    counts = calloc(number_of_producers, sizeof(*counts));
+    sums = calloc(number_of_producers, sizeof(*sums));
+    total_counts = calloc(number_of_producers, sizeof(*total_counts));
+    total_sums = calloc(number_of_producers, sizeof(*total_sums));
+    if (!counts || !sums || !total_counts || !total_sums)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    queue = open_queue(&devfd, flags);
+    if (pipe(tallies) < 0)
+    {
+        perror("pipe");
+        exit(1);
+    }
+
+    start = now();
+    for (i = 0; i < number_of_producers; i++)
+    {
+        if (fork() == 0)
+        {
+            queue = open_queue(&devfd, flags);
+            for (n = 0; n < per_producer; n++)
+            {
+                m.index = n;
+                m.producer = i;
+                while (mcontainer_queue_push(queue, &m) < 0)
+                {
+                    sched_yield();
+                }
+            }
+            _exit(0);
+        }
+    }
+    for (i = 0; i < number_of_consumers; i++)
+    {
+        if (fork() == 0)
+        {
+            queue = open_queue(&devfd, flags);
+            for (n = 0; n < per_consumer; n++)
+            {
+                while (mcontainer_queue_pop(queue, &m) < 0)
+                {
+                    sched_yield();
+                }
+                if (m.producer >= (unsigned long long)number_of_producers)
+                {
+                    _exit(1);
+                }
+                counts[m.producer]++;
+                sums[m.producer] += m.index;
+            }
+            if (write(tallies[1], counts, number_of_producers * sizeof(*counts)) < 0 ||
+                write(tallies[1], sums, number_of_producers * sizeof(*sums)) < 0)
+            {
+                _exit(1);
+            }
+            _exit(0);
+        }
+    }
+
+    // the tallies are read before the wait: a consumer blocks on a full pipe
+    close(tallies[1]);
+    for (i = 0; i < number_of_consumers; i++)
+    {
+        if (read_all(tallies[0], counts, number_of_producers * sizeof(*counts)) < 0 ||
+            read_all(tallies[0], sums, number_of_producers * sizeof(*sums)) < 0)
+        {
+            error = 1;
+            break;
+        }
+        for (j = 0; j < number_of_producers; j++)
+        {
+            total_counts[j] += counts[j];
+            total_sums[j] += sums[j];
+        }
+    }
+    for (i = 0; i < number_of_producers + number_of_consumers; i++)
+    {
+        wait(&stat);
+        if (!WIFEXITED(stat) || WEXITSTATUS(stat) != 0)
+        {
+            error = 1;
+        }
+    }
+    elapsed = now() - start;
+
+    // every message arrived once: per producer, as many indices as it pushed
+    // adding up to the pushed ones, so a duplicate cannot cover for a loss of
+    // another producer; and the queue is empty
+    for (i = 0; i < number_of_producers; i++)
+    {
+        if (total_counts[i] != (unsigned long long)per_producer ||
+            total_sums[i] != (unsigned long long)per_producer * (per_producer - 1) / 2)
+        {
+            error = 1;
+        }
+    }
+    if (mcontainer_queue_pop(queue, &m) == 0)
+    {
+        error = 1;
+    }
+
+    printf("%s %dx%d: %ld messages in %.3f s, %.1f M msg/s\n", flags == MCONTAINER_QUEUE_MPMC ? "mpmc" : "spsc",
+           number_of_producers, number_of_consumers, per_producer * number_of_producers, elapsed,
+           per_producer * number_of_producers / elapsed / 1e6);
+    printf(error ? "Fail\n" : "Pass\n");
+    // the next run may ask for another kind of queue at the same oid
+    mcontainer_queue_close(devfd, queue);
+    mcontainer_free(devfd, QUEUE_OID);
+    mcontainer_close(devfd);
+    free(counts);
+    free(sums);
+    free(total_counts);
+    free(total_sums);
+    return error;
+}
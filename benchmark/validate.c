@@ -34,6 +34,7 @@
 #include <sys/syscall.h>
 #include <time.h>
 #include <mcontainer.h>
+#include "payload.h"
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -47,8 +48,8 @@ int main(int argc, char *argv[])
     int number_of_objects = 1024, max_size_of_objects = 8192, number_of_containers = 1;
     int child_pid, cid, stat, devfd;
     long size;
-    __u64 object_id, current_time;
-    char *data, op, *mapped_data;
+    unsigned long long object_id, current_time, seed;
+    char op, *mapped_data;
     char ***containers;
     pid_t *pid;
 
@@ -66,7 +67,6 @@ int main(int argc, char *argv[])
     pid = (pid_t *) calloc(number_of_containers - 1, sizeof(pid_t));
 
     // allocate memory spaces
-    data = (char *)malloc(max_size_of_objects * sizeof(char));
     containers = (char ***)calloc(number_of_containers, sizeof(char **));
 
     for (i = 0; i < number_of_containers; i++)
@@ -80,12 +80,15 @@ int main(int argc, char *argv[])
     }
 
     // Replay the log to validate the results in containers.
-    while (scanf("%c %d %d %llu %llu %ld %s", &op, &child_pid, &cid, &current_time, &object_id, &size, &data[0]) != EOF)
+    while (scanf(" %c %d %d %llu %llu %ld %llx", &op, &child_pid, &cid, &current_time, &object_id, &size, &seed) == 7)
     {
+        if (size > max_size_of_objects)
+        {
+            size = max_size_of_objects;
+        }
         if (op == 'S')
         {
-            strcpy(containers[cid][(int)object_id], data);
-            memset(data, 0, max_size_of_objects);
+            payload_fill(containers[cid][(int)object_id], size, seed);
         }
         else if (op == 'D')
         {
@@ -94,7 +97,7 @@ int main(int argc, char *argv[])
     }
 
     // open the container kernel module to check the results.
-    devfd = open("/dev/mcontainer", O_RDWR);
+    devfd = mcontainer_init(MCONTAINER_BACKEND_DEFAULT);
     if (devfd < 0)
     {
         fprintf(stderr, "Device open failed");
@@ -121,9 +124,9 @@ int main(int argc, char *argv[])
     for (i = 0; i < number_of_objects; i++)
     {
         mapped_data = (char *)mcontainer_alloc(devfd, i, max_size_of_objects);
-        if (strcmp(mapped_data, containers[cid][i]) != 0)
+        if (memcmp(mapped_data, containers[cid][i], max_size_of_objects) != 0)
         {
-            fprintf(stderr, "Container %d Object %d has a wrong value %s v.s. %s\n", cid, i, mapped_data, containers[cid][i]);
+            fprintf(stderr, "Container %d Object %d has a wrong value\n", cid, i);
             error++;
         }
     }
@@ -137,7 +140,6 @@ int main(int argc, char *argv[])
     mcontainer_delete(devfd);
     
     close(devfd);
-    free(data);
     for (i = 0; i < number_of_containers; i++)
     {
         for (j = 0; j < number_of_objects; j++)
@@ -0,0 +1,270 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Description:
+//     Workload Profiles (oid/size distributions, read/write mix, rate)
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+enum workload_dist
+{
+    DIST_SEQUENTIAL = 0,
+    DIST_UNIFORM,
+    DIST_ZIPFIAN,
+    DIST_HOTSPOT,
+};
+
+enum workload_size
+{
+    SIZE_FIXED = 0,
+    SIZE_UNIFORM,
+    SIZE_EXPONENTIAL,
+};
+
+struct workload
+{
+    // configuration
+    int dist;
+    int size_dist;
+    int number_of_objects;
+    int max_size_of_objects;
+    double write_ratio;
+    double zipf_theta;
+    double hot_fraction;
+    double hot_probability;
+    double rate;
+
+    // generator state
+    uint64_t rng;
+    uint64_t next_index;
+    double zipf_zetan;
+    double zipf_alpha;
+    double zipf_eta;
+};
+
+/**
+ * xorshift64* generator, private to each process.
+ */
+static inline uint64_t workload_rand(struct workload *w)
+{
+    w->rng ^= w->rng >> 12;
+    w->rng ^= w->rng << 25;
+    w->rng ^= w->rng >> 27;
+    return w->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * uniform double in [0, 1)
+ */
+static inline double workload_uniform(struct workload *w)
+{
+    return (workload_rand(w) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Prepare the generator. Zipfian constants follow Gray et al. "Quickly
+ * Generating Billion-Record Synthetic Databases" as used by YCSB.
+ */
+static inline void workload_init(struct workload *w, uint64_t seed)
+{
+    double zeta2 = 0;
+    int i;
+
+    w->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    w->next_index = 0;
+    if (w->dist == DIST_ZIPFIAN)
+    {
+        w->zipf_zetan = 0;
+        for (i = 1; i <= w->number_of_objects; i++)
+        {
+            w->zipf_zetan += 1.0 / pow((double)i, w->zipf_theta);
+        }
+        zeta2 = 1.0 + 1.0 / pow(2.0, w->zipf_theta);
+        w->zipf_alpha = 1.0 / (1.0 - w->zipf_theta);
+        w->zipf_eta = (1.0 - pow(2.0 / w->number_of_objects, 1.0 - w->zipf_theta)) /
+                      (1.0 - zeta2 / w->zipf_zetan);
+    }
+}
+
+/**
+ * Pick the object of the next operation.
+ */
+static inline int workload_next_oid(struct workload *w)
+{
+    double u, uz;
+    int n = w->number_of_objects, hot;
+
+    switch (w->dist)
+    {
+    case DIST_UNIFORM:
+        return workload_rand(w) % n;
+    case DIST_ZIPFIAN:
+        u = workload_uniform(w);
+        uz = u * w->zipf_zetan;
+        if (uz < 1.0)
+        {
+            return 0;
+        }
+        if (uz < 1.0 + pow(0.5, w->zipf_theta))
+        {
+            return n > 1 ? 1 : 0;
+        }
+        hot = (int)(n * pow(w->zipf_eta * u - w->zipf_eta + 1.0, w->zipf_alpha));
+        return hot < n ? hot : n - 1;
+    case DIST_HOTSPOT:
+        hot = (int)(n * w->hot_fraction);
+        if (hot < 1)
+        {
+            hot = 1;
+        }
+        if (hot >= n || workload_uniform(w) < w->hot_probability)
+        {
+            return workload_rand(w) % hot;
+        }
+        return hot + workload_rand(w) % (n - hot);
+    default:
+        return w->next_index++ % n;
+    }
+}
+
+/**
+ * Decide whether the next operation writes (1) or only reads (0).
+ */
+static inline int workload_next_is_write(struct workload *w)
+{
+    if (w->write_ratio >= 1.0)
+    {
+        return 1;
+    }
+    return workload_uniform(w) < w->write_ratio;
+}
+
+/**
+ * Payload size of the next write; never larger than the mapped window.
+ */
+static inline int workload_next_size(struct workload *w)
+{
+    double size;
+
+    switch (w->size_dist)
+    {
+    case SIZE_UNIFORM:
+        return 1 + workload_rand(w) % w->max_size_of_objects;
+    case SIZE_EXPONENTIAL:
+        // mean of a quarter of the maximum, clamped to the window.
+        size = -log(1.0 - workload_uniform(w)) * w->max_size_of_objects / 4;
+        if (size < 1)
+        {
+            return 1;
+        }
+        return size > w->max_size_of_objects ? w->max_size_of_objects : (int)size;
+    default:
+        return w->max_size_of_objects;
+    }
+}
+
+static inline uint64_t workload_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Open-loop pacing: sleep until the scheduled start of operation i and
+ * return that time. Latency is measured from the schedule, not from when
+ * the operation actually got issued, so a slow module cannot hide its
+ * queueing delay. Without a target rate this is just "now".
+ */
+static inline uint64_t workload_pace(struct workload *w, uint64_t start_ns, uint64_t i)
+{
+    struct timespec ts;
+    uint64_t due;
+
+    if (w->rate <= 0)
+    {
+        return workload_now_ns();
+    }
+    due = start_ns + (uint64_t)(i * (1e9 / w->rate));
+    if (workload_now_ns() < due)
+    {
+        ts.tv_sec = due / 1000000000ULL;
+        ts.tv_nsec = due % 1000000000ULL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+    return due;
+}
+
+/**
+ * log2 latency histogram in nanoseconds.
+ */
+struct workload_stats
+{
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[64];
+};
+
+static inline void workload_record(struct workload_stats *s, uint64_t ns)
+{
+    int b = 0;
+
+    while (b < 63 && (ns >> b) > 1)
+    {
+        b++;
+    }
+    s->buckets[b]++;
+    s->total_ns += ns;
+    if (ns > s->max_ns)
+    {
+        s->max_ns = ns;
+    }
+}
+
+/**
+ * Upper bound of the bucket holding the given percentile.
+ */
+static inline uint64_t workload_percentile(struct workload_stats *s, double p)
+{
+    uint64_t ops = s->reads + s->writes, seen = 0;
+    int b;
+
+    for (b = 0; b < 64; b++)
+    {
+        seen += s->buckets[b];
+        if (seen && seen >= p * ops)
+        {
+            return 2ULL << b;
+        }
+    }
+    return s->max_ns;
+}
+
+#endif
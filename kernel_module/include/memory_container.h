@@ -34,17 +34,133 @@
 
 #include <linux/types.h>
 
+/*
+ * Every object owns 1 << MCONTAINER_OID_SHIFT pages of the device's mmap
+ * offset space: object oid starts at page offset oid << MCONTAINER_OID_SHIFT.
+ * This bounds an object to 4GB (with 4KB pages) and lets the module unmap
+ * exactly one object's pages from every task.
+ */
+#define MCONTAINER_OID_SHIFT 20
+
+/*
+ * Sequence counters for lock-free readers. Each container has a read-only
+ * area of MCONTAINER_SEQ_SIZE bytes, mapped at object MCONTAINER_SEQ_OID,
+ * holding one 64-bit counter every MCONTAINER_SEQ_STRIDE bytes; object oid
+ * uses slot oid % MCONTAINER_SEQ_SLOTS. Several objects share a slot, so a
+ * counter is not a plain odd/even seqcount: its low bits count the writers
+ * inside the slot (lock taken, not yet released) and the rest is a version
+ * bumped by every unlock. A read is consistent if it started with no
+ * writers and the counter is unchanged at its end.
+ */
+#define MCONTAINER_SEQ_OID 0x7fffffffULL
+#define MCONTAINER_SEQ_SIZE 65536
+#define MCONTAINER_SEQ_STRIDE 64
+#define MCONTAINER_SEQ_SLOTS (MCONTAINER_SEQ_SIZE / MCONTAINER_SEQ_STRIDE)
+#define MCONTAINER_SEQ_WRITERS 0xffffULL
+
+/*
+ * Small objects. MCONTAINER_IOCTL_ALLOC_SMALL packs an object of at most
+ * MCONTAINER_SMALL_MAX bytes into pages shared by the whole container and
+ * returns its byte offset in arg. Those pages are object
+ * MCONTAINER_SLAB_OID, which is mapped once and grows as objects are
+ * added; a page only ever holds chunks of one power-of-two size, so
+ * objects never straddle pages. Small objects are locked, subscribed to
+ * and freed by oid like any other.
+ */
+#define MCONTAINER_SLAB_OID 0x7ffffffeULL
+#define MCONTAINER_SMALL_MAX 2048
+
 struct memory_container_cmd
 {
     __u64 op;
     __u64 cid;
     __u64 oid;
+    __u64 size;
+    __u64 count;
+    __u64 arg;
+};
+
+/*
+ * Checkpoint file layout: a header, one index entry per object, then the
+ * pages of every object starting at page-aligned file offsets, so a
+ * restore can fault them straight out of the page cache.
+ */
+#define MCONTAINER_CHECKPOINT_MAGIC 0x4d434b5054000001ULL   /* "MCKPT", version 1 */
+
+struct mcontainer_checkpoint_header
+{
+    __u64 magic;
+    __u64 count;
+};
+
+struct mcontainer_checkpoint_entry
+{
+    __u64 oid;
+    __u64 npages;
+    __u64 offset;   /* file offset of the object's first page */
+};
+
+/*
+ * Events read from the device fd after MCONTAINER_IOCTL_SUBSCRIBE. An
+ * overflow means events were dropped and subscribed objects should be
+ * looked at again.
+ */
+#define MCONTAINER_EVENT_UNLOCK 1
+#define MCONTAINER_EVENT_FREE 2
+#define MCONTAINER_EVENT_OVERFLOW 3
+
+struct mcontainer_event
+{
+    __u64 oid;
+    __u64 type;
 };
 
+/*
+ * Usage of a container, filled in by MCONTAINER_IOCTL_STATS at arg.
+ * dedup_saved counts the bytes currently not backed because identical
+ * pages of the container share one page. compressed pages of cold objects
+ * take compressed_bytes instead of compressed * page size.
+ */
+struct mcontainer_stats
+{
+    __u64 objects;
+    __u64 bytes;        /* backing of all objects, shared pages counted each time */
+    __u64 dedup_saved;
+    __u64 dedup_merged; /* pages merged by dedup passes so far */
+    __u64 compressed;
+    __u64 compressed_bytes;
+    __u64 decompressed;  /* pages of live objects faulted back in */
+    __u64 decompress_ns; /* time spent on them */
+};
+
+/* op flags */
+#define MCONTAINER_OP_FD 0x1    /* import: arg is a memfd instead of a user address */
+#define MCONTAINER_OP_TIMEOUT 0x2   /* lock: give up after arg nanoseconds, 0 only tries */
+#define MCONTAINER_OP_EVENTFD 0x4   /* subscribe: also signal the eventfd in size */
+#define MCONTAINER_OP_BIND 0x8      /* create/delete: bind the container to this fd instead of the task */
+
 #define MCONTAINER_IOCTL_DELETE _IOWR('N', 0x45, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_CREATE _IOWR('N', 0x46, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_LOCK _IOWR('N', 0x47, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_UNLOCK _IOWR('N', 0x48, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_FREE _IOWR('N', 0x49, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_PREFETCH _IOWR('N', 0x4a, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_PREFETCH_WAIT _IOWR('N', 0x4b, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_RESIZE _IOWR('N', 0x4c, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_IMPORT _IOWR('N', 0x4d, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_EXPORT _IOWR('N', 0x4e, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_SNAPSHOT _IOWR('N', 0x4f, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_CHECKPOINT _IOWR('N', 0x50, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_RESTORE _IOWR('N', 0x51, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_TRACK_DIRTY _IOWR('N', 0x52, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_COLLECT_DIRTY _IOWR('N', 0x53, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_LOCK_MANY _IOWR('N', 0x54, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_UNLOCK_MANY _IOWR('N', 0x55, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_SUBSCRIBE _IOWR('N', 0x56, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_ALLOC_SMALL _IOWR('N', 0x57, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_DEDUP _IOWR('N', 0x58, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_STATS _IOWR('N', 0x59, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_COMPRESS _IOWR('N', 0x5a, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_MOVE _IOWR('N', 0x5b, struct memory_container_cmd)
 
 #endif
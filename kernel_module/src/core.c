@@ -45,6 +45,7 @@
 #include <linux/sched.h>
 
 extern struct miscdevice memory_container_dev;
+extern void memory_container_cleanup(void);
 
 
 int memory_container_init(void)
@@ -66,4 +67,5 @@ int memory_container_init(void)
 void memory_container_exit(void)
 {
     misc_deregister(&memory_container_dev);
+    memory_container_cleanup();
 }
@@ -46,32 +46,214 @@
 #include <linux/mutex.h>
 #include <linux/sched.h>
 #include <linux/kthread.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/kref.h>
+#include <linux/vmalloc.h>
+#include <linux/file.h>
+#include <linux/magic.h>
+#include <linux/cred.h>
+#include <linux/shmem_fs.h>
+#include <linux/highmem.h>
+#include <linux/pagemap.h>
+#include <linux/sort.h>
+#include <linux/eventfd.h>
+#include <linux/bsearch.h>
+#include <linux/rcupdate.h>
+#include <linux/hash.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/jhash.h>
+#include <linux/crypto.h>
+#include <linux/radix-tree.h>
+
+#define PAGE_INDEX_MASK ((1UL << MCONTAINER_OID_SHIFT) - 1)
+#define LOCK_MANY_MAX	65536	//objects a single lock_many may take
+#define LOCK_CHECK_JIFFIES	(HZ / 10)	//waiters look for an exited lock holder this often
+#define SEQ_PAGES	(MCONTAINER_SEQ_SIZE >> PAGE_SHIFT)
+#define SEQ_SLOTS_PER_PAGE	(PAGE_SIZE / MCONTAINER_SEQ_STRIDE)
+#define EVENT_QUEUE	256	//events buffered per subscribed file
+#define SLAB_MIN_SHIFT	6	//smallest chunk of a small object, 64 bytes
+#define SLAB_CLASSES	6	//chunk sizes up to MCONTAINER_SMALL_MAX
+#define SLAB_GROW	256	//pages the slab object grows by at most at once
+#define SLAB_USED	0x8	//where of a live entry is offset | SLAB_USED | class
+#define SLAB_DELETED	0x1
+#define SLAB_OFFSET(w)	((w) & ~((1ULL << SLAB_MIN_SHIFT) - 1))
+#define SLAB_CLASS(w)	((int)((w) & 0x7))
+#define ZBUF_SIZE	(2 * PAGE_SIZE)	//room for the worst lz4 output of a page
+
+// backing pages freed by the objects of a container, kept for its next ones //
+struct pagePool
+{
+	struct kref ref;		//held by the container and by each of its objects
+	spinlock_t lock;		//protects the lists and counts
+	struct list_head clean;		//zeroed, ready to hand out
+	struct list_head dirty;		//waiting for the zeroing work
+	unsigned long nclean;
+	unsigned long ndirty;
+	struct work_struct zero;
+};
 
 struct object
 {
 	__u64 oid;
 	struct object* next;
-	unsigned long long objspace;
+	struct kref ref;		//held by the object list and by every vma mapping the object
+	struct mutex page_mutex;	//protects pages, npages and mapping
+	struct page** pages;
+	unsigned long npages;
+	unsigned long* cow;		//pages shared with a snapshot, copied on first write
+	unsigned long* dirty;		//pages written since the last collect, when tracking
+	unsigned long* hashed;		//pages whose dedup hash is current, cleared by writes
+	u32* hashes;			//dedup hash of the pages set in hashed
+	struct address_space* mapping;	//of anchor, once the object has been mmapped
+	struct file* anchor;		//of the container, referenced, NULL until the object is added
+	atomic_t nmaps;			//vmas mapping the object
+	unsigned int flags;
+	struct file* backing;		//checkpoint file of a restored object, NULL pages load from it
+	loff_t backing_offset;
+	struct task_struct* owner;	//holder of the object lock, referenced while held
+	wait_queue_head_t lock_wait;
+	struct pagePool* pool;		//of the container, referenced, NULL until the object is added
+	unsigned long atime;		//jiffies of the last fault or lock
+	struct radix_tree_root zpages;	//index -> struct zpage of cold pages, whose pages are NULL
+	unsigned long nzpages;
+	unsigned long zbytes;		//compressed size of the zpages
+	unsigned long decompressed;	//zpages faulted back in
+	u64 decompress_ns;
+	struct rcu_head rcu;
 };
 
+// a page compressed away by the cold object scan //
+struct zpage
+{
+	size_t len;
+	unsigned char data[];
+};
+
+#define OBJ_IMPORTED	0x1	//pages were pinned from a user buffer or a memfd
+#define OBJ_TRACK_DIRTY	0x2	//record writes in the dirty bitmap
+
 struct task
 {
-	struct task_struct* thread;
+	struct task_struct* thread;	//referenced while in the container
 	struct task* next;
+	struct file* file;		//file the task joined through, leaves when it is released
+	struct rcu_head rcu;
+};
+
+// small object oid -> chunk of the slab object //
+struct slabEntry
+{
+	__u64 oid;
+	__u64 where;			//0 empty, SLAB_DELETED, or offset | SLAB_USED | class
+};
+
+// the shared pages small objects of a container are packed into //
+struct slab
+{
+	struct mutex mutex;		//protects everything below
+	struct object* obj;		//MCONTAINER_SLAB_OID, referenced, NULL until the first small object
+	unsigned long npages;		//pages of obj handed out to the classes
+	__u64 next[SLAB_CLASSES];	//next chunk in the current page of each class
+	__u32* free[SLAB_CLASSES];	//freed chunks, in units of the smallest one
+	unsigned long nfree[SLAB_CLASSES];
+	unsigned long freecap[SLAB_CLASSES];
+	struct slabEntry* table;	//open addressing on oid, always under half full
+	unsigned int bits;		//table has 1 << bits slots
+	unsigned long used;		//live and deleted slots
+	unsigned long live;
 };
 
 struct container
 {
 	__u64 cid;		
-	int task_cnt;
+	struct kref ref;	//held by the container list, subscribers, counter mappings, queued prefetches and running calls
+	int task_cnt;		//tasks and bound files, the container is torn down when it drops to 0
 	struct task* task_list;
 	struct container* next;
 	struct object* obj;
+	atomic_t prefetch_pending;
+	wait_queue_head_t prefetch_wait;
+	unsigned int flags;
+	struct page* seq[SEQ_PAGES];	//sequence counters, mapped read-only by readers
+	struct mutex sub_mutex;		//protects subs
+	struct subscriber* subs;
+	struct slab slab;
+	struct pagePool* pool;
+	struct file* anchor;		//its address space holds the vmas of the objects
+	struct delayed_work dedup_work;
+	atomic64_t dedup_merged;
+	struct delayed_work compress_work;
+	unsigned long cold_age;		//in jiffies
+	struct rcu_head rcu;
+};
+
+#define CTR_TRACK_DIRTY	0x1	//objects of the container track dirty pages
+#define CTR_DEDUP	0x2	//dedup passes run every dedup_interval ms
+#define CTR_DEDUP_READY	0x4	//dedup_work is initialized
+#define CTR_COMPRESS	0x8	//objects untouched for cold_age are compressed
+#define CTR_COMPRESS_READY	0x10	//compress_work is initialized
+#define CTR_DESTROYED	0x20	//torn down, only references keep it around
+
+// a file waiting for events on a set of objects of one container //
+struct subscriber
+{
+	struct container* ctr;
+	struct subscriber* next;
+	__u64* oids;			//sorted
+	unsigned long count;
+	struct eventfd_ctx* eventfd;
+	spinlock_t lock;		//protects the event ring
+	wait_queue_head_t wait;
+	struct mcontainer_event events[EVENT_QUEUE];
+	unsigned int head;
+	unsigned int tail;
+	bool overflow;
+};
+
+// per open file of the device //
+struct fileState
+{
+	struct object* exported;	//object an exported file maps, NULL for the device itself
+	struct subscriber* sub;
+	struct container* ctr;		//container bound with MCONTAINER_OP_BIND, NULL to look up by task
+};
+
+struct prefetch_work
+{
+	struct work_struct work;
+	struct container* ctr;
+	__u64 oid;
+	__u64 count;
+	unsigned long npages;
 };
 
+// the container list, the task lists and the object lists are published with //
+// rcu_assign_pointer and freed after a grace period, so lookups walk them //
+// under rcu_read_lock; my_mutex and obj_mutex only serialize the writers //
 static struct container* ctr_list = NULL;  //list of containers
 
+static bool persistent;
+module_param(persistent, bool, 0644);
+MODULE_PARM_DESC(persistent, "keep containers and their objects after the last task leaves");
+
+static unsigned int pool_pages = 256;
+module_param(pool_pages, uint, 0644);
+MODULE_PARM_DESC(pool_pages, "freed backing pages each container keeps for reuse");
+
+static unsigned int dedup_interval = 10000;
+module_param(dedup_interval, uint, 0644);
+MODULE_PARM_DESC(dedup_interval, "milliseconds between dedup passes of a container");
+
+// lz4 goes through the crypto api, so the module loads where lz4 is not built //
+// in and compression is refused where it cannot be found. A transform is not //
+// reentrant: faults share this one under lz4_mutex, scans allocate their own //
+static struct crypto_comp* lz4_tfm;
+DEFINE_MUTEX(lz4_mutex);
+
 DEFINE_MUTEX(my_mutex); //working with global lock  
+DEFINE_MUTEX(obj_mutex); //protects the object lists of all containers
 
 struct container* getContainerFromCid(__u64 cid)
 {
@@ -95,7 +277,7 @@ struct container* getContainerFromCid(__u64 cid)
 	return ctrNode;
 }
 
-struct task* getNewTask( void )
+struct task* getNewTask(struct file* filp)
 {
 	struct task* tn = NULL;
 	tn = (struct task*)kmalloc(sizeof(struct task), GFP_KERNEL);
@@ -107,12 +289,153 @@ struct task* getNewTask( void )
 
 	tn->next = NULL;
 	tn->thread = current;
+	tn->file = filp;
+	get_task_struct(current);
 	return tn;
 }
 
+static void freeTask(struct task* tn)
+{
+	put_task_struct(tn->thread);
+	kfree_rcu(tn, rcu);
+}
+
+static void freeSeqPages(struct container* ctrNode)
+{
+	int i;
+
+	for(i = 0; i < SEQ_PAGES; i++)
+	{
+		if(ctrNode->seq[i] != NULL)
+		{
+			put_page(ctrNode->seq[i]);
+		}
+	}
+}
+
+//Page pool: freed pages are zeroed in the background and handed to the//
+//next object of the same container without going to the page allocator//
+
+static void poolZeroWork(struct work_struct *work)
+{
+	struct pagePool* pool = container_of(work, struct pagePool, zero);
+	struct page* page;
+
+	spin_lock(&pool->lock);
+	while(!list_empty(&pool->dirty))
+	{
+		page = list_first_entry(&pool->dirty, struct page, lru);
+		list_del(&page->lru);
+		pool->ndirty--;
+		spin_unlock(&pool->lock);
+
+		clear_highpage(page);
+
+		spin_lock(&pool->lock);
+		list_add(&page->lru, &pool->clean);
+		pool->nclean++;
+	}
+	spin_unlock(&pool->lock);
+}
+
+static struct pagePool* getNewPool(void)
+{
+	struct pagePool* pool = kzalloc(sizeof(struct pagePool), GFP_KERNEL);
+
+	if(pool == NULL)
+	{
+		return NULL;
+	}
+	kref_init(&pool->ref);
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->clean);
+	INIT_LIST_HEAD(&pool->dirty);
+	INIT_WORK(&pool->zero, poolZeroWork);
+	return pool;
+}
+
+static void freePageList(struct list_head* list)
+{
+	struct page* page;
+	struct page* next;
+
+	list_for_each_entry_safe(page, next, list, lru)
+	{
+		list_del(&page->lru);
+		put_page(page);
+	}
+}
+
+static void releasePool(struct kref* ref)
+{
+	struct pagePool* pool = container_of(ref, struct pagePool, ref);
+
+	cancel_work_sync(&pool->zero);
+	freePageList(&pool->clean);
+	freePageList(&pool->dirty);
+	kfree(pool);
+}
+
+static void putPool(struct pagePool* pool)
+{
+	kref_put(&pool->ref, releasePool);
+}
+
+// a zeroed page, from the pool if it has one //
+static struct page* poolGetPage(struct pagePool* pool)
+{
+	struct page* page = NULL;
+
+	if(pool != NULL)
+	{
+		spin_lock(&pool->lock);
+		if(!list_empty(&pool->clean))
+		{
+			page = list_first_entry(&pool->clean, struct page, lru);
+			list_del(&page->lru);
+			pool->nclean--;
+		}
+		spin_unlock(&pool->lock);
+	}
+	if(page == NULL)
+	{
+		page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	}
+	return page;
+}
+
+// keeping a page nobody else holds, up to pool_pages per container //
+// pages that came from a checkpoint's page cache never go in, even once //
+// truncated, since they may still sit on an LRU list //
+static void poolPutPage(struct pagePool* pool, struct page* page)
+{
+	bool kept = false;
+
+	if(pool != NULL && page_count(page) == 1 && page->mapping == NULL && !PageLRU(page))
+	{
+		spin_lock(&pool->lock);
+		if(pool->nclean + pool->ndirty < pool_pages)
+		{
+			list_add(&page->lru, &pool->dirty);
+			pool->ndirty++;
+			kept = true;
+		}
+		spin_unlock(&pool->lock);
+	}
+	if(kept)
+	{
+		queue_work(system_unbound_wq, &pool->zero);
+	}
+	else
+	{
+		put_page(page);
+	}
+}
+
 struct container* getNewContainer(__u64 cid)
 {
 	struct container* ctrNode = NULL;
+	int i;
 	ctrNode = (struct container*)kmalloc(sizeof(struct container), GFP_KERNEL);
 	
 	if(ctrNode == NULL)
@@ -120,428 +443,3770 @@ struct container* getNewContainer(__u64 cid)
 		//printk("Unable to create a container...\n");
 		return NULL;
 	}
+	ctrNode->pool = getNewPool();
+	if(ctrNode->pool == NULL)
+	{
+		kfree(ctrNode);
+		return NULL;
+	}
+	//counters exist from the start, a reader may map them while a writer is inside
+	for(i = 0; i < SEQ_PAGES; i++)
+	{
+		ctrNode->seq[i] = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if(ctrNode->seq[i] == NULL)
+		{
+			while(i-- > 0)
+			{
+				put_page(ctrNode->seq[i]);
+			}
+			putPool(ctrNode->pool);
+			kfree(ctrNode);
+			return NULL;
+		}
+	}
+	//the device's own address space is shared by every container, and an
+	//oid unmapped there would be zapped in all of them
+	ctrNode->anchor = shmem_file_setup("mcontainer", 0, VM_NORESERVE);
+	if(IS_ERR(ctrNode->anchor))
+	{
+		freeSeqPages(ctrNode);
+		putPool(ctrNode->pool);
+		kfree(ctrNode);
+		return NULL;
+	}
+	kref_init(&ctrNode->ref);
 	ctrNode->task_cnt = 1;
 	ctrNode->cid = cid;
 	ctrNode->next = NULL;
 	ctrNode->task_list = NULL;
 	ctrNode->obj = NULL;
+	ctrNode->flags = 0;
+	ctrNode->subs = NULL;
+	mutex_init(&ctrNode->sub_mutex);
+	memset(&ctrNode->slab, 0, sizeof(struct slab));
+	mutex_init(&ctrNode->slab.mutex);
+	atomic64_set(&ctrNode->dedup_merged, 0);
+	atomic_set(&ctrNode->prefetch_pending, 0);
+	init_waitqueue_head(&ctrNode->prefetch_wait);
 		
 	return ctrNode; 
 }
 
-// getting container id of the current task //
-struct container* getContainer(pid_t pid)
+// per-page arrays of large objects do not fit in kmalloc //
+static void* allocArray(size_t bytes)
 {
-	//printk("Finding the CID of current pid %d...... \n", pid);
-	
-	struct container* ctrNode;
-
-	if(ctr_list == NULL)
+	if(bytes <= PAGE_SIZE)
 	{
-		//printk("Container not found\n");
-		return NULL;
+		return kzalloc(max_t(size_t, bytes, 1), GFP_KERNEL);
 	}
-	ctrNode = ctr_list;
-	
-	struct task * tmp = NULL;
+	return vzalloc(bytes);
+}
 
-	while(ctrNode != NULL)
+static struct page** allocPageArray(unsigned long npages)
+{
+	return allocArray(npages * sizeof(struct page*));
+}
+
+static unsigned long* allocPageBitmap(unsigned long npages)
+{
+	return allocArray(BITS_TO_LONGS(npages) * sizeof(unsigned long));
+}
+
+// growing an optional per-page bitmap, bits of new pages start cleared //
+static int growBitmap(unsigned long** bitmap, unsigned long oldpages, unsigned long npages)
+{
+	unsigned long* map;
+
+	if(*bitmap == NULL || BITS_TO_LONGS(npages) <= BITS_TO_LONGS(oldpages))
 	{
-		tmp = ctrNode->task_list;
-		while(tmp!=NULL)
-		{
-			if(tmp->thread->pid == pid)
-			{
-				//printk("Container found for current pid....%llu \n", ctrNode->cid);		
-				return ctrNode;
-			}
-			tmp= tmp->next;		
-		}
-		ctrNode= ctrNode->next;			
+		return 0;
 	}
-	return ctrNode;
+	map = allocPageBitmap(npages);
+	if(map == NULL)
+	{
+		return -ENOMEM;
+	}
+	memcpy(map, *bitmap, BITS_TO_LONGS(oldpages) * sizeof(unsigned long));
+	kvfree(*bitmap);
+	*bitmap = map;
+	return 0;
 }
 
-// Memory-Mapping function
-int memory_container_mmap(struct file *filp, struct vm_area_struct *vma)
+// byte offset of an object in the device's mmap space //
+static loff_t objectOffset(struct object* obj)
 {
-	//printk("\nmmap called..... \n");
-  
-	__u64 oid = vma->vm_pgoff;
+	return (loff_t)obj->oid << (MCONTAINER_OID_SHIFT + PAGE_SHIFT);
+}
 
-	struct container* ctrNode = getContainer(current->pid);
+// freeing the compressed copy of a page, if there is one, page_mutex held //
+static void dropZPage(struct object* obj, unsigned long index)
+{
+	struct zpage* zp = radix_tree_delete(&obj->zpages, index);
 
-	if(ctrNode == NULL)
+	if(zp != NULL)
 	{
-		//printk("Container not found...!!! \n");
+		obj->nzpages--;
+		obj->zbytes -= zp->len;
+		kfree(zp);
 	}
-	else
+}
+
+// dropping the object's reference on one backing page //
+static void releasePage(struct object* obj, struct page* page)
+{
+	if(page == NULL)
+	{
+		//restored page that was never loaded
+		return;
+	}
+	//imported pages belong to someone else, keep what we wrote through them
+	if(obj->flags & OBJ_IMPORTED)
 	{
-		//printk("Container found inside mmap....\n");
-		//for a given container
+		set_page_dirty_lock(page);
+		put_page(page);
+		return;
+	}
+	poolPutPage(obj->pool, page);
+}
 
-		//create object reference
-		struct object* temp = ctrNode->obj;
-	
-		bool flag = false;
+// growing or shrinking the backing of an object in place, page_mutex held //
+// pages past the new end are unmapped from every task before they are released //
+int resizePages(struct object* obj, unsigned long npages)
+{
+	struct page** pages;
+	unsigned long i;
 
-		if(temp == NULL)
+	//a resized object is hashed all over again by the next dedup pass
+	if(npages != obj->npages)
+	{
+		kvfree(obj->hashed);
+		kvfree(obj->hashes);
+		obj->hashed = NULL;
+		obj->hashes = NULL;
+	}
+	if(npages < obj->npages)
+	{
+		if(obj->mapping != NULL)
 		{
-			//create a new memory object
-			struct object* con_obj = kcalloc(1,sizeof(struct object), GFP_KERNEL);
-			con_obj->oid = oid;
-			con_obj->next = NULL;
-			con_obj->objspace = kcalloc(1,vma->vm_end - vma->vm_start, GFP_KERNEL);
-	
-			//printk("Creating first memory object of container with cid %llu and object id %llu \n", ctrNode->cid, oid);
-			
-			//link this created object to the specific container
-			ctrNode->obj = con_obj;
-			temp = ctrNode->obj;
+			unmap_mapping_range(obj->mapping, objectOffset(obj) + ((loff_t)npages << PAGE_SHIFT),
+					    (loff_t)(obj->npages - npages) << PAGE_SHIFT, 1);
 		}
-		else if(temp->oid != oid)
+		for(i = npages; i < obj->npages; i++)
 		{
-			//if there exists only one object
-			while(temp->next != NULL)
+			if(obj->pages[i] == NULL)
 			{
-				if(temp->next->oid == oid)
-				{
-					temp= temp->next;
-					flag = true;
-					//printk("Object for container with cid %llu and object id %llu \n", ctrNode->cid, oid);
-					break;
-				}
-				temp = temp->next;
+				dropZPage(obj, i);
 			}
-			if(!flag)
+			releasePage(obj, obj->pages[i]);
+			obj->pages[i] = NULL;
+			if(obj->cow != NULL)
 			{
-				//if no object already exists, create one
-				//printk("Creating object for container with cid %llu and object id %llu \n", ctrNode->cid, oid);
-
-				struct object* con_obj = kcalloc(1,sizeof(struct object), GFP_KERNEL);
-				con_obj->oid = oid;
-				con_obj->next = NULL;
-				con_obj->objspace = kcalloc(1,vma->vm_end - vma->vm_start, GFP_KERNEL);
-
-				temp->next = con_obj;
-				temp = temp->next;
+				clear_bit(i, obj->cow);
+			}
+			if(obj->dirty != NULL)
+			{
+				clear_bit(i, obj->dirty);
 			}
 		}
-		else
+		obj->npages = npages;
+		return 0;
+	}
+	if(npages == obj->npages && obj->pages != NULL)
+	{
+		return 0;
+	}
+
+	//bitmaps may end up larger than the object if the pages cannot be had
+	if(growBitmap(&obj->cow, obj->npages, npages) < 0 ||
+	   growBitmap(&obj->dirty, obj->npages, npages) < 0)
+	{
+		return -ENOMEM;
+	}
+	pages = allocPageArray(npages);
+	if(pages == NULL)
+	{
+		return -ENOMEM;
+	}
+	for(i = obj->npages; i < npages; i++)
+	{
+		pages[i] = poolGetPage(obj->pool);
+		if(pages[i] == NULL)
 		{
-			//Referring the first object
-			//printk("Object already exists! And the first one too!");
+			while(i-- > obj->npages)
+			{
+				put_page(pages[i]);
+			}
+			kvfree(pages);
+			return -ENOMEM;
 		}
-		
-		unsigned long long *k_malloc;
+	}
+	if(obj->npages)
+	{
+		memcpy(pages, obj->pages, obj->npages * sizeof(struct page*));
+	}
+	kvfree(obj->pages);
+	obj->pages = pages;
+	obj->npages = npages;
+	return 0;
+}
 
-		k_malloc = PAGE_ALIGN(temp->objspace);
-				
-		unsigned long pfn = virt_to_phys((void *)temp->objspace)>>PAGE_SHIFT;
-    
-		//printk("Physical Mem location .... %x ", pfn);
+// allocating an object with npages of zeroed backing //
+struct object* getNewObject(__u64 oid, unsigned long npages)
+{
+	struct object* obj = kzalloc(sizeof(struct object), GFP_KERNEL);
+
+	if(obj == NULL)
+	{
+		return NULL;
+	}
+	obj->oid = oid;
+	obj->next = NULL;
+	kref_init(&obj->ref);
+	mutex_init(&obj->page_mutex);
+	init_waitqueue_head(&obj->lock_wait);
+	obj->atime = jiffies;
+	INIT_RADIX_TREE(&obj->zpages, GFP_KERNEL);
+	if(resizePages(obj, npages) < 0)
+	{
+		kfree(obj);
+		return NULL;
+	}
+	return obj;
+}
 
-		int ans;
+static void releaseObject(struct kref* ref)
+{
+	struct object* obj = container_of(ref, struct object, ref);
+	unsigned long i;
 
-		ans = remap_pfn_range(vma, vma->vm_start, pfn, vma->vm_end - vma->vm_start, vma->vm_page_prot);
-		
-		if(ans < 0)
+	for(i = 0; i < obj->npages; i++)
+	{
+		if(obj->pages[i] == NULL)
 		{
-			//printk("Sorry! could not map the address.... \n");
-			return -EIO;
-		} 
+			dropZPage(obj, i);
+		}
+		releasePage(obj, obj->pages[i]);
 	}
-
-    return 0;
+	kvfree(obj->pages);
+	kvfree(obj->cow);
+	kvfree(obj->dirty);
+	kvfree(obj->hashed);
+	kvfree(obj->hashes);
+	if(obj->backing != NULL)
+	{
+		fput(obj->backing);
+	}
+	if(obj->owner != NULL)
+	{
+		//held by a task that left without unlocking
+		put_task_struct(obj->owner);
+	}
+	if(obj->pool != NULL)
+	{
+		putPool(obj->pool);
+	}
+	if(obj->anchor != NULL)
+	{
+		fput(obj->anchor);
+	}
+	kfree_rcu(obj, rcu);
 }
 
-
-//Locking function
-int memory_container_lock(struct memory_container_cmd __user *user_cmd)
+void putObject(struct object* obj)
 {
-	//printk("\nLocking..... \n");	
-	mutex_lock(&my_mutex);
-    return 0;
+	kref_put(&obj->ref, releaseObject);
 }
 
-//Unlocking function
-int memory_container_unlock(struct memory_container_cmd __user *user_cmd)
+static void putObjectList(struct object* obj)
 {
-	//printk("\nUnlocking..... \n");	
-	mutex_unlock(&my_mutex);
-    return 0;
+	struct object* next;
+
+	while(obj != NULL)
+	{
+		next = obj->next;
+		putObject(obj);
+		obj = next;
+	}
 }
 
-//Deletion function
-int memory_container_delete(struct memory_container_cmd __user *user_cmd)
+static void releaseSlab(struct slab* sl)
 {
-	struct memory_container_cmd ctrCmd;
-    	struct container* ctrNode = NULL;
-    	struct task* temp = NULL;
-    	struct task* prev = NULL;
+	int c;
 
-    	copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd));
-	//printk("\n\n");
-    	//printk( "try to take lock %d \n",current->pid);
-    	mutex_lock(&my_mutex);
-    	//printk( "Attained lock %d \n",current->pid);
-    
-    	//printk( "Delete called Container with cid = %llu \n",ctrCmd.cid);
-	
-	//get the container for current running process
-	ctrNode = getContainer(current->pid);	
-	
-    	if(ctrNode == NULL )
-	{
-        	//printk( "Container not found %llu \n",ctrNode->cid);
-        	//printk( "releasing lock %d",current->pid);
-        	mutex_unlock(&my_mutex);
-        	return 0;
-    	}
-      	//printk( "Delete: Container found %llu \n",ctrNode->cid);
-    
-    	if(ctrNode->task_list == NULL )
+	for(c = 0; c < SLAB_CLASSES; c++)
 	{
-        	//printk( "Container has no tasks %llu \n",ctrNode->cid);
-	        //printk( "releasing lock %d \n",current->pid);
-	        mutex_unlock(&my_mutex);
-	        return 0;
+		kvfree(sl->free[c]);
 	}
-
-    	if (ctrNode->task_list->next == NULL)
+	kvfree(sl->table);
+	if(sl->obj != NULL)
 	{
-        	// only 1 task in container, delete only the task and not the container
-        	//printk( "Delete: only 1 task in container %llu \n",ctrNode->cid);
-        	ctrNode->task_cnt = 0;
-		temp = ctrNode->task_list;
-		ctrNode->task_list = NULL;
-        	kfree(temp);
-        	//printk( "releasing lock %d \n",current->pid);
-        	mutex_unlock(&my_mutex);
-        	return 0;
-    	}
-	else 
-	{
-        	// first task to be deleted
-        	//printk( "Delete: delete a task %llu pid= %d\n",ctrNode->cid, current->pid);
-        	if (current == ctrNode->task_list->thread)
-		{
-            		//printk( "Delete: first task to be deleted %llu \n",ctrNode->cid);
-            
-            		temp = ctrNode->task_list;
-            		ctrNode->task_list = ctrNode->task_list->next;
-            		ctrNode->task_cnt -=1;
-            		kfree(temp);
-        	}
-		else
-		{
-            		//printk( "Delete: not the first task to be deleted %llu \n",ctrNode->cid);
-            		temp = ctrNode->task_list;
-            		prev = temp;
-            		while(temp != NULL && temp->thread != current)
-			{
-	                	prev = temp;
-	                	temp = temp->next;
-	            	}
-	            //printk( "Delete: still here!!%llu \n",ctrNode->cid);
-
-            		if (temp!= NULL && temp->next == NULL )
-			{	
-        	        	//printk( "Delete: last node to be deleted  %llu \n",ctrNode->cid);
-        	        	// if temp is last node
-        	        	ctrNode->task_cnt -=1;
-        	        	prev->next = NULL;
-        	        	kfree(temp);
-     	  		}
-			else if (temp!=NULL && temp->next != NULL)
-			{
-                		//printk( "Delete: not the last node to be deleted  %llu \n",ctrNode->cid);
-                		ctrNode->task_cnt -=1;
-                		prev->next = temp->next;
-                		kfree(temp);
-            		}
-			else
-			{
-                		//just-in-case 
-        			//printk( "releasing lock %d \n",current->pid);
-                		mutex_unlock(&my_mutex);
-                		return 0;
-            		}
-        	}
-        
-    }    
-	//printk( "releasing lock %d \n",current->pid);
-	mutex_unlock(&my_mutex);
-    return 0;
+		putObject(sl->obj);
+	}
 }
 
-//Creation function
-int memory_container_create(struct memory_container_cmd __user *user_cmd)
+// objects added after the container was torn down go with its last reference //
+static void releaseContainer(struct kref* ref)
 {
-	struct container* ctrNode = NULL;
-	struct task* tn= NULL;
-	struct task* temp= NULL;
+	struct container* ctrNode = container_of(ref, struct container, ref);
 
+	releaseSlab(&ctrNode->slab);
+	putObjectList(ctrNode->obj);
+	putPool(ctrNode->pool);
+	freeSeqPages(ctrNode);
+	fput(ctrNode->anchor);
+	kfree_rcu(ctrNode, rcu);
+}
 
-	struct memory_container_cmd ctrCmd;
-	copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd));
-	
-	//printk("Try to take the lock %d \n", current->pid);
-	mutex_lock(&my_mutex);
-	//printk("Attained lock %d \n", current->pid);
+static void putContainer(struct container* ctrNode)
+{
+	kref_put(&ctrNode->ref, releaseContainer);
+}
 
-	ctrNode = getContainerFromCid(ctrCmd.cid);
-	
-	if(ctrNode != NULL)
+// finding an object of a container, obj_mutex held //
+// under rcu_read_lock or obj_mutex //
+struct object* getObject(struct container* ctrNode, __u64 oid)
+{
+	struct object* temp = rcu_dereference_check(ctrNode->obj, lockdep_is_held(&obj_mutex));
+
+	while(temp != NULL && temp->oid != oid)
 	{
-		//printk("Container exists %llu \n", ctrNode->cid);
+		temp = rcu_dereference_check(temp->next, lockdep_is_held(&obj_mutex));
+	}
+	return temp;
+}
 
-		tn = getNewTask();
-		//printk("\n after getNewtask!\n");
-		
-		if(tn == NULL)
+// linking an object at the end of the container's object list, obj_mutex held //
+void addObject(struct container* ctrNode, struct object* obj)
+{
+	struct object* temp = ctrNode->obj;
+
+	if(ctrNode->flags & CTR_TRACK_DIRTY)
+	{
+		obj->flags |= OBJ_TRACK_DIRTY;
+	}
+	if(obj->pool == NULL)
+	{
+		kref_get(&ctrNode->pool->ref);
+		obj->pool = ctrNode->pool;
+	}
+	if(obj->anchor == NULL)
+	{
+		obj->anchor = get_file(ctrNode->anchor);
+	}
+
+	if(temp == NULL)
+	{
+		rcu_assign_pointer(ctrNode->obj, obj);
+		return;
+	}
+	while(temp->next != NULL)
+	{
+		temp = temp->next;
+	}
+	rcu_assign_pointer(temp->next, obj);
+}
+
+// finding (or creating, without backing) an object and taking a reference //
+static struct object* getObjectRef(struct container* ctrNode, __u64 oid, int create)
+{
+	struct object* obj;
+	bool found;
+
+	//lock-free lookup first; a count of 0 is an object on its way out or
+	//one putIdleObject is checking, and obj_mutex tells which
+	rcu_read_lock();
+	obj = getObject(ctrNode, oid);
+	found = obj != NULL && kref_get_unless_zero(&obj->ref);
+	rcu_read_unlock();
+	if(found || (obj == NULL && !create))
+	{
+		return obj;
+	}
+
+	mutex_lock(&obj_mutex);
+	obj = getObject(ctrNode, oid);
+	if(obj == NULL && create)
+	{
+		obj = getNewObject(oid, 0);
+		if(obj != NULL)
 		{
-			//printk("releasing the lock, task not created %d \n", current->pid);
-			mutex_unlock(&my_mutex);
-			return 0;
+			addObject(ctrNode, obj);
 		}
+	}
+	if(obj != NULL)
+	{
+		kref_get(&obj->ref);
+	}
+	mutex_unlock(&obj_mutex);
+	return obj;
+}
 
-		ctrNode->task_cnt +=1;
+// dropping the caller's reference, and the object with it if nothing uses //
+// it any more: no backing, no lock holder and no reference but the list's //
+static void putIdleObject(struct container* ctrNode, struct object* obj)
+{
+	struct object** link;
+	bool idle;
 
-		//Adding task to the list
+	if(obj->oid == MCONTAINER_SLAB_OID || READ_ONCE(obj->npages) != 0 || READ_ONCE(obj->owner) != NULL)
+	{
+		putObject(obj);
+		return;
+	}
 
-		if(ctrNode->task_list == NULL)
+	mutex_lock(&obj_mutex);
+	//a container being torn down has already taken its list away
+	for(link = &ctrNode->obj; *link != NULL && *link != obj; link = &(*link)->next)
+	{
+	}
+	//holding the lock word keeps lockers off while the count is checked;
+	//lockers and waiters hold references, so a count of 2 means none
+	idle = *link != NULL && cmpxchg(&obj->owner, NULL, current) == NULL;
+	if(idle && atomic_cmpxchg(&obj->ref.refcount, 2, 0) != 2)
+	{
+		smp_store_release(&obj->owner, NULL);
+		wake_up(&obj->lock_wait);
+		idle = false;
+	}
+	if(idle && (obj->npages != 0 || obj->nzpages != 0 || obj->backing != NULL))
+	{
+		//refilled before the count was taken; lookups meanwhile wait on obj_mutex
+		atomic_set(&obj->ref.refcount, 2);
+		smp_store_release(&obj->owner, NULL);
+		wake_up(&obj->lock_wait);
+		idle = false;
+	}
+	if(idle)
+	{
+		rcu_assign_pointer(*link, obj->next);
+	}
+	mutex_unlock(&obj_mutex);
+
+	if(!idle)
+	{
+		putObject(obj);
+		return;
+	}
+	//rcu readers still walking through it go on to obj->next
+	obj->owner = NULL;
+	releaseObject(&obj->ref);
+}
+
+//Small objects: chunks of the slab object, found through an oid table//
+
+static int slabClass(__u64 size)
+{
+	int c = 0;
+
+	while((1ULL << (c + SLAB_MIN_SHIFT)) < size)
+	{
+		c++;
+	}
+	return c;
+}
+
+static struct slabEntry* slabLookup(struct slab* sl, __u64 oid)
+{
+	unsigned long mask = (1UL << sl->bits) - 1;
+	unsigned long i;
+
+	if(sl->table == NULL)
+	{
+		return NULL;
+	}
+	for(i = hash_64(oid, sl->bits); sl->table[i].where != 0; i = (i + 1) & mask)
+	{
+		if((sl->table[i].where & SLAB_USED) && sl->table[i].oid == oid)
 		{
-			//printk("tasks added at start.\n");
-			ctrNode->task_list = tn;
+			return &sl->table[i];
 		}
-		else
-		{
-			//printk("task added at last.\n");
-			tn->next = ctrNode->task_list;
-			ctrNode->task_list = tn;			
-		}	
 	}
-	else
-	{
-		//printk("Container Not Found %llu, creating a new container... \n", ctrCmd.cid);
-		ctrNode = getNewContainer(ctrCmd.cid);
+	return NULL;
+}
 
-		if(ctrNode == NULL)
+// a fresh table four times the live entries, which also drops deleted slots //
+static int slabRehash(struct slab* sl)
+{
+	struct slabEntry* old = sl->table;
+	unsigned long oldsize = old != NULL ? 1UL << sl->bits : 0;
+	unsigned int bits = 10;
+	unsigned long i, j, mask;
+
+	while((1UL << bits) < sl->live * 4)
+	{
+		bits++;
+	}
+	sl->table = allocArray(sizeof(struct slabEntry) << bits);
+	if(sl->table == NULL)
+	{
+		sl->table = old;
+		return -ENOMEM;
+	}
+	sl->bits = bits;
+	sl->used = sl->live;
+	mask = (1UL << bits) - 1;
+	for(i = 0; i < oldsize; i++)
+	{
+		if(old[i].where & SLAB_USED)
 		{
-			//printk("getNewContainer failed %llu \n", ctrCmd.cid);
-			//printk("releasing lock %d", current->pid);
-			mutex_unlock(&my_mutex);
-			return 0;
+			for(j = hash_64(old[i].oid, bits); sl->table[j].where != 0; j = (j + 1) & mask)
+			{
+			}
+			sl->table[j] = old[i];
 		}
-	
-		//printk("creating new task for the container.... %llu \n", ctrCmd.cid);
-		
-		tn = getNewTask();
+	}
+	kvfree(old);
+	return 0;
+}
 
-		if(tn == NULL)
+static int slabInsert(struct slab* sl, __u64 oid, __u64 where)
+{
+	unsigned long mask;
+	unsigned long i;
+
+	if((sl->table == NULL || (sl->used + 1) * 2 > (1UL << sl->bits)) && slabRehash(sl) < 0)
+	{
+		return -ENOMEM;
+	}
+	mask = (1UL << sl->bits) - 1;
+	for(i = hash_64(oid, sl->bits); sl->table[i].where & SLAB_USED; i = (i + 1) & mask)
+	{
+	}
+	if(sl->table[i].where == 0)
+	{
+		sl->used++;
+	}
+	sl->table[i].oid = oid;
+	sl->table[i].where = where;
+	sl->live++;
+	return 0;
+}
+
+// a chunk of class c, from its free list or carved from the class page //
+static int slabChunk(struct slab* sl, int c, __u64* offset)
+{
+	unsigned long npages;
+	int ret;
+
+	if(sl->nfree[c] > 0)
+	{
+		*offset = (__u64)sl->free[c][--sl->nfree[c]] << SLAB_MIN_SHIFT;
+		return 0;
+	}
+	//a class page is used up exactly at the next page boundary
+	if((sl->next[c] & ~PAGE_MASK) == 0)
+	{
+		if(sl->npages == sl->obj->npages)
 		{
-			//printk("getNewTask Failed %llu... \n", ctrCmd.cid);
-			//printk("releasing the lock.... %d", current->pid);
-			mutex_unlock(&my_mutex);
-			return 0;
+			npages = sl->npages + clamp_t(unsigned long, sl->npages, 1, SLAB_GROW);
+			npages = min_t(unsigned long, npages, PAGE_INDEX_MASK + 1);
+			if(npages == sl->npages)
+			{
+				return -ENOSPC;
+			}
+			mutex_lock(&sl->obj->page_mutex);
+			ret = resizePages(sl->obj, npages);
+			mutex_unlock(&sl->obj->page_mutex);
+			if(ret < 0)
+			{
+				return ret;
+			}
 		}
-		
-		ctrNode->task_list = tn;
+		sl->next[c] = (__u64)sl->npages++ << PAGE_SHIFT;
+	}
+	*offset = sl->next[c];
+	sl->next[c] += 1ULL << (c + SLAB_MIN_SHIFT);
+	return 0;
+}
 
-		if(ctr_list ==  NULL)
+static int slabPutChunk(struct slab* sl, int c, __u64 offset)
+{
+	__u32* grown;
+	unsigned long cap;
+
+	if(sl->nfree[c] == sl->freecap[c])
+	{
+		cap = max_t(unsigned long, sl->freecap[c] * 2, PAGE_SIZE / sizeof(__u32));
+		grown = allocArray(cap * sizeof(__u32));
+		if(grown == NULL)
 		{
-			//printk("Adding the first container %llu..... \n", ctrCmd.cid);
-			ctr_list = ctrNode;
+			return -ENOMEM;
 		}
-		else
+		if(sl->nfree[c])
 		{
-			//printk("Adding additional container %llu..... \n", ctrCmd.cid);
-			ctrNode->next = ctr_list;
-			ctr_list = ctrNode;
+			memcpy(grown, sl->free[c], sl->nfree[c] * sizeof(__u32));
 		}
+		kvfree(sl->free[c]);
+		sl->free[c] = grown;
+		sl->freecap[c] = cap;
 	}
-	//printk("releasing the lock %d", current->pid);
-	mutex_unlock(&my_mutex);
+	sl->free[c][sl->nfree[c]++] = offset >> SLAB_MIN_SHIFT;
+	return 0;
+}
 
-    return 0;
+// releasing the chunk of a small object, returns 1 if oid had one //
+static int slabFree(struct container* ctrNode, __u64 oid)
+{
+	struct slab* sl = &ctrNode->slab;
+	struct slabEntry* e;
+	int ret = 0;
+
+	mutex_lock(&sl->mutex);
+	e = slabLookup(sl, oid);
+	if(e != NULL)
+	{
+		//without room on the free list the chunk is leaked, the entry goes anyway
+		slabPutChunk(sl, SLAB_CLASS(e->where), SLAB_OFFSET(e->where));
+		e->where = SLAB_DELETED;
+		sl->live--;
+		ret = 1;
+	}
+	mutex_unlock(&sl->mutex);
+	return ret;
 }
 
+// the snapshot dst takes over the layout of src, both slab mutexes held //
+static int slabCopy(struct container* dst, struct slab* src)
+{
+	struct slab* sl = &dst->slab;
+	int c;
 
-//Memory free function
-int memory_container_free(struct memory_container_cmd __user *user_cmd)
+	sl->obj = getObjectRef(dst, MCONTAINER_SLAB_OID, 0);
+	sl->npages = src->npages;
+	memcpy(sl->next, src->next, sizeof(sl->next));
+	for(c = 0; c < SLAB_CLASSES; c++)
+	{
+		if(src->nfree[c] == 0)
+		{
+			continue;
+		}
+		sl->free[c] = allocArray(src->freecap[c] * sizeof(__u32));
+		if(sl->free[c] == NULL)
+		{
+			return -ENOMEM;
+		}
+		memcpy(sl->free[c], src->free[c], src->nfree[c] * sizeof(__u32));
+		sl->nfree[c] = src->nfree[c];
+		sl->freecap[c] = src->freecap[c];
+	}
+	if(src->table != NULL)
+	{
+		sl->table = allocArray(sizeof(struct slabEntry) << src->bits);
+		if(sl->table == NULL)
+		{
+			return -ENOMEM;
+		}
+		memcpy(sl->table, src->table, sizeof(struct slabEntry) << src->bits);
+		sl->bits = src->bits;
+		sl->used = src->used;
+		sl->live = src->live;
+	}
+	return 0;
+}
+
+// getting container id of the current task, referenced: put it when done //
+// entries hold their task, so a recycled pid of an exited one never matches //
+struct container* getContainer(struct task_struct* tsk)
 {
-	struct memory_container_cmd ctrCmd;	
+	//printk("Finding the CID of current pid %d...... \n", tsk->pid);
 
-	
-	copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd));
+	struct container* ctrNode;
+	struct task * tmp = NULL;
 
-	//printk("Inside free().... \n");
-	
-	struct container* ctrNode = getContainer(current->pid);
+	//another thread releasing the file the task joined through drops its
+	//entry and may tear the container down, so the reference is taken
+	//before leaving rcu; a container already going away is not found
+	rcu_read_lock();
+	ctrNode = rcu_dereference(ctr_list);
+	while(ctrNode != NULL)
+	{
+		tmp = rcu_dereference(ctrNode->task_list);
+		while(tmp!=NULL)
+		{
+			if(tmp->thread == tsk)
+			{
+				//printk("Container found for current pid....%llu \n", ctrNode->cid);
+				if(!kref_get_unless_zero(&ctrNode->ref))
+				{
+					ctrNode = NULL;
+				}
+				rcu_read_unlock();
+				return ctrNode;
+			}
+			tmp= rcu_dereference(tmp->next);		
+		}
+		ctrNode= rcu_dereference(ctrNode->next);			
+	}
+	rcu_read_unlock();
+	return ctrNode;
+}
 
-	//printk("Container id inside free()=%llu \n", ctrNode->cid);
+// container an ioctl or mmap on filp works on, referenced: put it when done //
+// a bound fd carries its container, others fall back to the task lookup //
+static struct container* fileContainer(struct file* filp)
+{
+	struct fileState* state = filp->private_data;
+	struct container* ctrNode;
 
-	if(ctrNode == NULL)	
+	//filp is pinned by the call, so its release cannot drop the binding
+	//meanwhile; an unbind by another thread can, hence the reference
+	rcu_read_lock();
+	ctrNode = READ_ONCE(state->ctr);
+	if(ctrNode != NULL && !kref_get_unless_zero(&ctrNode->ref))
 	{
-		//printk("No Container exists... \n");
+		ctrNode = NULL;
 	}
-	else
+	rcu_read_unlock();
+	if(ctrNode != NULL)
 	{
-		//printk("Memory free for container id %llu and object id %llu = \n",ctrNode->cid, ctrNode->obj->oid);
+		return ctrNode;
+	}
+	return getContainer(current);
+}
 
-		struct object* temp_ref = ctrNode->obj;
-		
-		//printk("CMD oid= %llu and container oid= %llu \n", ctrCmd.oid, temp_ref->oid);
+// tearing down a container nobody is in any more, my_mutex held //
+// objects go with it; mappings still hold their own references //
+static void destroyContainer(struct container* ctrNode)
+{
+	struct container** link;
+	struct object* obj;
+	struct task* tn;
 
-		if(temp_ref == NULL)
+	for(link = &ctr_list; *link != NULL; link = &(*link)->next)
+	{
+		if(*link == ctrNode)
 		{
-			//printk("No object to free \n");
+			RCU_INIT_POINTER(*link, ctrNode->next);
+			break;
 		}
-		
-		//Deleting first object
-		if(temp_ref->oid == ctrCmd.oid)
+	}
+	while(ctrNode->task_list != NULL)
+	{
+		tn = ctrNode->task_list;
+		RCU_INIT_POINTER(ctrNode->task_list, tn->next);
+		freeTask(tn);
+	}
+
+	//callers still holding a reference must not start the scans again
+	mutex_lock(&obj_mutex);
+	ctrNode->flags &= ~(CTR_DEDUP | CTR_COMPRESS);
+	ctrNode->flags |= CTR_DESTROYED;
+	mutex_unlock(&obj_mutex);
+	if(ctrNode->flags & CTR_DEDUP_READY)
+	{
+		cancel_delayed_work_sync(&ctrNode->dedup_work);
+	}
+	if(ctrNode->flags & CTR_COMPRESS_READY)
+	{
+		cancel_delayed_work_sync(&ctrNode->compress_work);
+	}
+
+	mutex_lock(&obj_mutex);
+	obj = ctrNode->obj;
+	RCU_INIT_POINTER(ctrNode->obj, NULL);
+	mutex_unlock(&obj_mutex);
+	putObjectList(obj);
+	putContainer(ctrNode);
+}
+
+// count members left the container, my_mutex held //
+static void leaveContainer(struct container* ctrNode, int count)
+{
+	ctrNode->task_cnt -= count;
+	if(ctrNode->task_cnt <= 0 && !persistent)
+	{
+		destroyContainer(ctrNode);
+	}
+}
+
+// unlinking the tasks of ctrNode that match, my_mutex held //
+// returns how many were dropped so the caller can leave for them //
+static int dropTasks(struct container* ctrNode, struct file* filp, bool exited)
+{
+	struct task** link = &ctrNode->task_list;
+	struct task* temp;
+	int dropped = 0;
+
+	while(*link != NULL)
+	{
+		temp = *link;
+		if((filp != NULL && temp->file == filp) ||
+		   (exited && (temp->thread->flags & PF_EXITING)))
 		{
-			if(temp_ref->next == NULL)
-			{
-				//printk("Only object of the container.. \n");
-				ctrNode->obj = NULL;
-				kfree(temp_ref); //free the temp pointer
-				//printk("Freed only object  \n");
-			}
-			else
-			{
-				//printk("First object of the container.... \n");
-				ctrNode->obj = temp_ref->next;
-				kfree(temp_ref);
-				//printk("Freed first object  \n");
-			}
+			RCU_INIT_POINTER(*link, temp->next);
+			freeTask(temp);
+			dropped++;
 		}
 		else
 		{
-			//printk("Middle object of the container ... \n");
+			link = &temp->next;
+		}
+	}
+	return dropped;
+}
 
-			struct object *prev;
+//binding a container to an open file, the task is not added to it //
+static int bindContainer(struct file* filp, __u64 cid)
+{
+	struct fileState* state = filp->private_data;
+	struct container* ctrNode;
 
-			while((temp_ref->oid != ctrCmd.oid)&&(temp_ref->next != NULL))	
-			{
-				prev = temp_ref;
-				temp_ref = temp_ref->next;
-			}
-			
-			if(temp_ref->oid == ctrCmd.oid)
-			{
-				prev->next = temp_ref->next;
-				kfree(temp_ref);
-				//printk("Freed middle object  \n");
-			}
-			else
-			{
-				//printk("Sorry, No object found!! \n");
-			}
+	mutex_lock(&my_mutex);
+	if(state->ctr != NULL)
+	{
+		mutex_unlock(&my_mutex);
+		return -EBUSY;
+	}
+	ctrNode = getContainerFromCid(cid);
+	if(ctrNode == NULL)
+	{
+		ctrNode = getNewContainer(cid);
+		if(ctrNode == NULL)
+		{
+			mutex_unlock(&my_mutex);
+			return -ENOMEM;
 		}
-	}	
-    return 0;
+		ctrNode->next = ctr_list;
+		rcu_assign_pointer(ctr_list, ctrNode);
+	}
+	else
+	{
+		ctrNode->task_cnt += 1;
+	}
+	WRITE_ONCE(state->ctr, ctrNode);
+	mutex_unlock(&my_mutex);
+	return 0;
+}
+
+static int unbindContainer(struct file* filp)
+{
+	struct fileState* state = filp->private_data;
+
+	mutex_lock(&my_mutex);
+	if(state->ctr != NULL)
+	{
+		leaveContainer(state->ctr, 1);
+		WRITE_ONCE(state->ctr, NULL);
+	}
+	mutex_unlock(&my_mutex);
+	return 0;
+}
+
+// a released file takes its binding and every task that joined through it //
+static void releaseFileContainers(struct file* filp)
+{
+	struct container* ctrNode;
+	struct container* next;
+	int dropped;
+
+	unbindContainer(filp);
+	mutex_lock(&my_mutex);
+	for(ctrNode = ctr_list; ctrNode != NULL; ctrNode = next)
+	{
+		next = ctrNode->next;
+		dropped = dropTasks(ctrNode, filp, false);
+		if(dropped > 0)
+		{
+			leaveContainer(ctrNode, dropped);
+		}
+	}
+	mutex_unlock(&my_mutex);
+}
+
+// module exit: no file is open any more, whatever is left goes //
+void memory_container_cleanup(void)
+{
+	//queued prefetches run module code
+	flush_workqueue(system_unbound_wq);
+	mutex_lock(&my_mutex);
+	while(ctr_list != NULL)
+	{
+		destroyContainer(ctr_list);
+	}
+	mutex_unlock(&my_mutex);
+	if(lz4_tfm != NULL)
+	{
+		crypto_free_comp(lz4_tfm);
+	}
+}
+
+// bringing back a page the cold object scan compressed, page_mutex held //
+static int decompressPage(struct object* obj, unsigned long index, struct zpage* zp)
+{
+	struct page* page;
+	unsigned int len = PAGE_SIZE;
+	u64 start = ktime_get_ns();
+	void* addr;
+	int err;
+
+	page = poolGetPage(obj->pool);
+	if(page == NULL)
+	{
+		return -ENOMEM;
+	}
+	//compressed pages only exist once lz4_tfm does
+	mutex_lock(&lz4_mutex);
+	addr = kmap_atomic(page);
+	err = crypto_comp_decompress(lz4_tfm, zp->data, zp->len, addr, &len);
+	kunmap_atomic(addr);
+	mutex_unlock(&lz4_mutex);
+	if(err < 0 || len != PAGE_SIZE)
+	{
+		put_page(page);
+		return -EIO;
+	}
+	obj->pages[index] = page;
+	dropZPage(obj, index);
+	obj->decompressed++;
+	obj->decompress_ns += ktime_get_ns() - start;
+	return 0;
+}
+
+// filling in a NULL page, page_mutex held: a compressed page is decompressed, //
+// a page of a restored object is read from its checkpoint. The page cache //
+// page is used as is and marked cow, so writes never reach the file //
+static int loadPage(struct object* obj, unsigned long index)
+{
+	struct zpage* zp;
+	struct page* page;
+
+	if(obj->pages[index] != NULL)
+	{
+		return 0;
+	}
+	zp = radix_tree_lookup(&obj->zpages, index);
+	if(zp != NULL)
+	{
+		return decompressPage(obj, index, zp);
+	}
+	if(obj->backing == NULL)
+	{
+		return -EIO;
+	}
+	page = read_mapping_page(obj->backing->f_mapping, (obj->backing_offset >> PAGE_SHIFT) + index, obj->backing);
+	if(IS_ERR(page))
+	{
+		return PTR_ERR(page);
+	}
+	obj->pages[index] = page;
+	set_bit(index, obj->cow);
+	return 0;
+}
+
+// vmas hold a reference on the object they map, and are counted //
+static void memory_container_vm_open(struct vm_area_struct *vma)
+{
+	struct object* obj = vma->vm_private_data;
+
+	kref_get(&obj->ref);
+	atomic_inc(&obj->nmaps);
+}
+
+static void memory_container_vm_close(struct vm_area_struct *vma)
+{
+	struct object* obj = vma->vm_private_data;
+
+	atomic_dec(&obj->nmaps);
+	putObject(obj);
+}
+
+// pages are inserted on first touch, so an object can grow and shrink under //
+// existing mappings; touching past the end of the object raises SIGBUS //
+static int memory_container_vm_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct object* obj = vma->vm_private_data;
+	unsigned long index = vmf->pgoff & PAGE_INDEX_MASK;
+	int ret = VM_FAULT_SIGBUS;
+	int err;
+
+	mutex_lock(&obj->page_mutex);
+	obj->atime = jiffies;
+	if(index < obj->npages && loadPage(obj, index) < 0)
+	{
+		ret = VM_FAULT_SIGBUS;
+	}
+	else if(index < obj->npages)
+	{
+		err = vm_insert_pfn(vma, (unsigned long)vmf->virtual_address, page_to_pfn(obj->pages[index]));
+		if(err == 0 || err == -EBUSY)
+		{
+			ret = VM_FAULT_NOPAGE;
+		}
+		else if(err == -ENOMEM)
+		{
+			ret = VM_FAULT_OOM;
+		}
+	}
+	mutex_unlock(&obj->page_mutex);
+	return ret;
+}
+
+// pages are always inserted read-only (having pfn_mkwrite turns on write //
+// notification), so the first write to a page comes here. A page still //
+// shared with a snapshot is replaced by a private copy; the stale pte is //
+// zapped from every task and the write retried through the fault handler. //
+// Writes to objects that track dirty pages are recorded, and the page is //
+// hashed again by the next dedup pass //
+static int memory_container_vm_pfn_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct object* obj = vma->vm_private_data;
+	unsigned long index = vmf->pgoff & PAGE_INDEX_MASK;
+	struct page* copy;
+	int ret = 0;
+
+	mutex_lock(&obj->page_mutex);
+	obj->atime = jiffies;
+	if(index < obj->npages && obj->hashed != NULL)
+	{
+		clear_bit(index, obj->hashed);
+	}
+	if(index >= obj->npages)
+	{
+		ret = VM_FAULT_SIGBUS;
+	}
+	else if(obj->cow != NULL && test_bit(index, obj->cow))
+	{
+		//the other side may have copied already, then the page is ours alone
+		if(page_count(obj->pages[index]) > 1)
+		{
+			copy = alloc_page(GFP_KERNEL);
+			if(copy == NULL)
+			{
+				mutex_unlock(&obj->page_mutex);
+				return VM_FAULT_OOM;
+			}
+			copy_highpage(copy, obj->pages[index]);
+			put_page(obj->pages[index]);
+			obj->pages[index] = copy;
+			unmap_mapping_range(obj->mapping, objectOffset(obj) + ((loff_t)index << PAGE_SHIFT), PAGE_SIZE, 1);
+			ret = VM_FAULT_NOPAGE;
+		}
+		clear_bit(index, obj->cow);
+	}
+	if(ret == 0 && (obj->flags & OBJ_TRACK_DIRTY))
+	{
+		if(obj->dirty == NULL)
+		{
+			obj->dirty = allocPageBitmap(obj->npages);
+		}
+		if(obj->dirty == NULL)
+		{
+			ret = VM_FAULT_OOM;
+		}
+		else
+		{
+			set_bit(index, obj->dirty);
+		}
+	}
+	mutex_unlock(&obj->page_mutex);
+	return ret;
+}
+
+static const struct vm_operations_struct memory_container_vm_ops = {
+	.open = memory_container_vm_open,
+	.close = memory_container_vm_close,
+	.fault = memory_container_vm_fault,
+	.pfn_mkwrite = memory_container_vm_pfn_mkwrite,
+};
+
+// counter of the slot of an object //
+static atomic64_t* seqSlot(struct container* ctrNode, __u64 oid)
+{
+	unsigned long slot = oid % MCONTAINER_SEQ_SLOTS;
+
+	return (atomic64_t*)((char*)page_address(ctrNode->seq[slot / SEQ_SLOTS_PER_PAGE]) +
+			     (slot % SEQ_SLOTS_PER_PAGE) * MCONTAINER_SEQ_STRIDE);
+}
+
+// a writer enters the slot: readers starting now wait, running ones retry //
+static void seqWriteBegin(struct container* ctrNode, __u64 oid)
+{
+	atomic64_add_return(1, seqSlot(ctrNode, oid));
+}
+
+// the writer leaves and bumps the version, in one update //
+static void seqWriteEnd(struct container* ctrNode, __u64 oid)
+{
+	atomic64_add_return(MCONTAINER_SEQ_WRITERS, seqSlot(ctrNode, oid));
+}
+
+static int memory_container_seq_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct container* ctrNode = vma->vm_private_data;
+	unsigned long index = vmf->pgoff & PAGE_INDEX_MASK;
+	int err;
+
+	if(index >= SEQ_PAGES)
+	{
+		return VM_FAULT_SIGBUS;
+	}
+	err = vm_insert_pfn(vma, (unsigned long)vmf->virtual_address, page_to_pfn(ctrNode->seq[index]));
+	if(err == 0 || err == -EBUSY)
+	{
+		return VM_FAULT_NOPAGE;
+	}
+	return err == -ENOMEM ? VM_FAULT_OOM : VM_FAULT_SIGBUS;
+}
+
+static void memory_container_seq_open(struct vm_area_struct *vma)
+{
+	struct container* ctrNode = vma->vm_private_data;
+
+	kref_get(&ctrNode->ref);
+}
+
+static void memory_container_seq_close(struct vm_area_struct *vma)
+{
+	putContainer(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct memory_container_seq_vm_ops = {
+	.open = memory_container_seq_open,
+	.close = memory_container_seq_close,
+	.fault = memory_container_seq_fault,
+};
+
+// mapping the sequence counters of the current container, read-only //
+static int seqMmap(struct container* ctrNode, struct vm_area_struct *vma)
+{
+	if(vma->vm_flags & VM_WRITE)
+	{
+		return -EPERM;
+	}
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_PFNMAP | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_ops = &memory_container_seq_vm_ops;
+	vma->vm_private_data = ctrNode;
+	kref_get(&ctrNode->ref);
+	return 0;
+}
+
+// Memory-Mapping function
+int memory_container_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	//printk("\nmmap called..... \n");
+  
+	__u64 oid = vma->vm_pgoff >> MCONTAINER_OID_SHIFT;
+	unsigned long npages = (vma->vm_pgoff & PAGE_INDEX_MASK) + ((vma->vm_end - vma->vm_start) >> PAGE_SHIFT);
+	struct fileState* state = filp->private_data;
+	struct container* ctrNode;
+	struct object* temp;
+	int ret;
+
+	if(!(vma->vm_flags & VM_SHARED) || npages > PAGE_INDEX_MASK + 1)
+	{
+		return -EINVAL;
+	}
+
+	if(state->exported != NULL)
+	{
+		//an exported object: offsets are relative to the object, and the
+		//vma is moved to the object's range so revocation reaches it too
+		temp = state->exported;
+		if(vma->vm_pgoff > PAGE_INDEX_MASK)
+		{
+			return -EINVAL;
+		}
+		kref_get(&temp->ref);
+		vma->vm_pgoff += (unsigned long)temp->oid << MCONTAINER_OID_SHIFT;
+	}
+	else
+	{
+		ctrNode = fileContainer(filp);
+		if(ctrNode == NULL)
+		{
+			//printk("Container not found...!!! \n");
+			return 0;
+		}
+		if(oid == MCONTAINER_SEQ_OID)
+		{
+			ret = seqMmap(ctrNode, vma);
+			putContainer(ctrNode);
+			return ret;
+		}
+
+		//if no object already exists (and none was prefetched), create one;
+		//it gets its backing below like one emptied by free
+		temp = getObjectRef(ctrNode, oid, 1);
+		putContainer(ctrNode);
+		if(temp == NULL)
+		{
+			return -ENOMEM;
+		}
+	}
+
+	mutex_lock(&temp->page_mutex);
+	//objects created by a lock or emptied by free get their backing here;
+	//the slab only grows as small objects are packed into it
+	if(temp->npages == 0 && state->exported == NULL && temp->oid != MCONTAINER_SLAB_OID &&
+	   resizePages(temp, npages) < 0)
+	{
+		mutex_unlock(&temp->page_mutex);
+		putObject(temp);
+		return -ENOMEM;
+	}
+	temp->mapping = temp->anchor->f_mapping;
+	atomic_inc(&temp->nmaps);
+	mutex_unlock(&temp->page_mutex);
+
+	//the vma goes on the address space of the object's container, so
+	//unmapping the object reaches no task mapping the same oid elsewhere
+	fput(vma->vm_file);
+	vma->vm_file = get_file(temp->anchor);
+
+	// the window may extend past the object; those pages fault in once the object grows
+	vma->vm_flags |= VM_PFNMAP | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_ops = &memory_container_vm_ops;
+	vma->vm_private_data = temp;
+
+    return 0;
+}
+
+// unlinking and freeing the subscription of a file //
+static void putSubscriber(struct subscriber* sub)
+{
+	struct subscriber** link;
+
+	mutex_lock(&sub->ctr->sub_mutex);
+	for(link = &sub->ctr->subs; *link != NULL; link = &(*link)->next)
+	{
+		if(*link == sub)
+		{
+			*link = sub->next;
+			break;
+		}
+	}
+	mutex_unlock(&sub->ctr->sub_mutex);
+	putContainer(sub->ctr);
+	if(sub->eventfd != NULL)
+	{
+		eventfd_ctx_put(sub->eventfd);
+	}
+	kvfree(sub->oids);
+	kfree(sub);
+}
+
+// Open function: every open file gets its own state //
+int memory_container_open(struct inode *inode, struct file *filp)
+{
+	struct fileState* state = kzalloc(sizeof(struct fileState), GFP_KERNEL);
+
+	if(state == NULL)
+	{
+		return -ENOMEM;
+	}
+	filp->private_data = state;
+	return 0;
+}
+
+// Release function: exported files drop their object, subscriptions end //
+int memory_container_release(struct inode *inode, struct file *filp)
+{
+	struct fileState* state = filp->private_data;
+
+	if(state->exported != NULL)
+	{
+		putObject(state->exported);
+	}
+	if(state->sub != NULL)
+	{
+		putSubscriber(state->sub);
+	}
+	releaseFileContainers(filp);
+	kfree(state);
+	return 0;
+}
+
+static int compareOid(const void* a, const void* b)
+{
+	__u64 x = *(const __u64*)a, y = *(const __u64*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+// queueing an event for every subscriber of the object //
+static void notifyObject(struct container* ctrNode, __u64 oid, __u64 type)
+{
+	struct subscriber* sub;
+	unsigned long flags;
+
+	if(READ_ONCE(ctrNode->subs) == NULL)
+	{
+		return;
+	}
+	mutex_lock(&ctrNode->sub_mutex);
+	for(sub = ctrNode->subs; sub != NULL; sub = sub->next)
+	{
+		if(bsearch(&oid, sub->oids, sub->count, sizeof(__u64), compareOid) == NULL)
+		{
+			continue;
+		}
+		spin_lock_irqsave(&sub->lock, flags);
+		if(sub->tail - sub->head < EVENT_QUEUE)
+		{
+			sub->events[sub->tail % EVENT_QUEUE].oid = oid;
+			sub->events[sub->tail % EVENT_QUEUE].type = type;
+			sub->tail++;
+		}
+		else
+		{
+			sub->overflow = true;
+		}
+		spin_unlock_irqrestore(&sub->lock, flags);
+		wake_up_interruptible(&sub->wait);
+		if(sub->eventfd != NULL)
+		{
+			eventfd_signal(sub->eventfd, 1);
+		}
+	}
+	mutex_unlock(&ctrNode->sub_mutex);
+}
+
+static bool eventsPending(struct subscriber* sub)
+{
+	return READ_ONCE(sub->tail) != READ_ONCE(sub->head) || READ_ONCE(sub->overflow);
+}
+
+// Poll function: readable while events are queued //
+unsigned int memory_container_poll(struct file *filp, poll_table *wait)
+{
+	struct fileState* state = filp->private_data;
+
+	if(state->sub == NULL)
+	{
+		return POLLERR;
+	}
+	poll_wait(filp, &state->sub->wait, wait);
+	return eventsPending(state->sub) ? POLLIN | POLLRDNORM : 0;
+}
+
+// Read function: returns queued struct mcontainer_event records //
+ssize_t memory_container_read(struct file *filp, char __user *buf, size_t len, loff_t *pos)
+{
+	struct fileState* state = filp->private_data;
+	struct subscriber* sub = state->sub;
+	struct mcontainer_event event;
+	unsigned long flags;
+	size_t done = 0;
+	int ret;
+
+	if(sub == NULL)
+	{
+		return -EINVAL;
+	}
+	if(len < sizeof(event))
+	{
+		return -EINVAL;
+	}
+	if(!eventsPending(sub))
+	{
+		if(filp->f_flags & O_NONBLOCK)
+		{
+			return -EAGAIN;
+		}
+		ret = wait_event_interruptible(sub->wait, eventsPending(sub));
+		if(ret < 0)
+		{
+			return ret;
+		}
+	}
+
+	while(done + sizeof(event) <= len)
+	{
+		spin_lock_irqsave(&sub->lock, flags);
+		if(sub->overflow)
+		{
+			//dropped events come first, the reader has to rescan anyway
+			event.oid = 0;
+			event.type = MCONTAINER_EVENT_OVERFLOW;
+			sub->overflow = false;
+		}
+		else if(sub->head != sub->tail)
+		{
+			event = sub->events[sub->head % EVENT_QUEUE];
+			sub->head++;
+		}
+		else
+		{
+			spin_unlock_irqrestore(&sub->lock, flags);
+			break;
+		}
+		spin_unlock_irqrestore(&sub->lock, flags);
+		if(copy_to_user(buf + done, &event, sizeof(event)))
+		{
+			return done ? done : -EFAULT;
+		}
+		done += sizeof(event);
+	}
+	return done;
+}
+
+// Prefetch worker: allocates and zeroes the backing of every object in the
+// requested range that does not exist yet, off the caller's request path.
+static void prefetchWork(struct work_struct *work)
+{
+	struct prefetch_work* pw = container_of(work, struct prefetch_work, work);
+	struct object* obj;
+	__u64 oid;
+
+	for(oid = pw->oid; oid < pw->oid + pw->count; oid++)
+	{
+		mutex_lock(&obj_mutex);
+		obj = getObject(pw->ctr, oid);
+		mutex_unlock(&obj_mutex);
+		if(obj != NULL)
+		{
+			continue;
+		}
+
+		//allocate outside the list lock, someone may have created it meanwhile
+		obj = getNewObject(oid, pw->npages);
+		if(obj == NULL)
+		{
+			break;
+		}
+		mutex_lock(&obj_mutex);
+		if(getObject(pw->ctr, oid) == NULL)
+		{
+			addObject(pw->ctr, obj);
+			obj = NULL;
+		}
+		mutex_unlock(&obj_mutex);
+		if(obj != NULL)
+		{
+			putObject(obj);
+		}
+	}
+
+	if(atomic_dec_and_test(&pw->ctr->prefetch_pending))
+	{
+		wake_up_all(&pw->ctr->prefetch_wait);
+	}
+	putContainer(pw->ctr);
+	kfree(pw);
+}
+
+//Prefetch function
+int memory_container_prefetch(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct prefetch_work* pw;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	//the range must not wrap or reach the slab and the counter area
+	if(ctrCmd.count == 0 || ctrCmd.oid + ctrCmd.count < ctrCmd.oid ||
+	   ctrCmd.oid + ctrCmd.count > MCONTAINER_SLAB_OID)
+	{
+		return -EINVAL;
+	}
+	if(ctrCmd.size == 0)
+	{
+		return 0;
+	}
+	if(PAGE_ALIGN(ctrCmd.size) >> PAGE_SHIFT > PAGE_INDEX_MASK + 1)
+	{
+		return -EFBIG;
+	}
+
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+
+	pw = kmalloc(sizeof(struct prefetch_work), GFP_KERNEL);
+	if(pw == NULL)
+	{
+		putContainer(ctrNode);
+		return -ENOMEM;
+	}
+	INIT_WORK(&pw->work, prefetchWork);
+	pw->ctr = ctrNode;		//the work takes over the reference
+	pw->oid = ctrCmd.oid;
+	pw->count = ctrCmd.count;
+	pw->npages = PAGE_ALIGN(ctrCmd.size) >> PAGE_SHIFT;
+
+	atomic_inc(&ctrNode->prefetch_pending);
+	queue_work(system_unbound_wq, &pw->work);
+	return 0;
+}
+
+//Wait until all prefetches issued in the current container are done
+int memory_container_prefetch_wait(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct container* ctrNode = fileContainer(filp);
+	int ret;
+
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+	ret = wait_event_killable(ctrNode->prefetch_wait, atomic_read(&ctrNode->prefetch_pending) == 0);
+	putContainer(ctrNode);
+	return ret;
+}
+
+
+// taking the object lock if it is free //
+static bool tryLockObject(struct object* obj)
+{
+	if(cmpxchg(&obj->owner, NULL, current) != NULL)
+	{
+		return false;
+	}
+	get_task_struct(current);
+	return true;
+}
+
+// taking the lock from a holder that exited without unlocking, sleeps //
+// the holder can no longer unlock and wakes nobody, so its write ends here //
+static bool takeOverObject(struct container* ctrNode, struct object* obj)
+{
+	struct task_struct* owner;
+	bool taken = false;
+
+	//the cmpxchg stays under rcu so the dead holder cannot be freed and its
+	//address reused by a new holder in between
+	rcu_read_lock();
+	owner = READ_ONCE(obj->owner);
+	if(owner != NULL && (READ_ONCE(owner->flags) & PF_EXITING))
+	{
+		taken = cmpxchg(&obj->owner, owner, current) == owner;
+	}
+	rcu_read_unlock();
+	if(!taken)
+	{
+		return false;
+	}
+	get_task_struct(current);
+	seqWriteEnd(ctrNode, obj->oid);
+	//spinners may still be looking at the old holder
+	synchronize_rcu();
+	put_task_struct(owner);
+	return true;
+}
+
+#ifdef CONFIG_SMP
+// spinning while the lock holder is running on another cpu, it is likely //
+// to release the lock before a sleep and wakeup would complete //
+static bool spinOnOwner(struct object* obj)
+{
+	struct task_struct* owner;
+	bool acquired = false;
+
+	//owner stays valid under rcu (and the reference taken in tryLockObject)
+	rcu_read_lock();
+	while(!acquired)
+	{
+		owner = READ_ONCE(obj->owner);
+		if(owner == NULL)
+		{
+			acquired = tryLockObject(obj);
+			continue;
+		}
+		if(!READ_ONCE(owner->on_cpu) || (READ_ONCE(owner->flags) & PF_EXITING) || need_resched())
+		{
+			break;
+		}
+		cpu_relax();
+	}
+	rcu_read_unlock();
+	return acquired;
+}
+#else
+// on a single cpu the holder cannot run while its waiter spins //
+static bool spinOnOwner(struct object* obj)
+{
+	return false;
+}
+#endif
+
+// sleeping until the lock is free, timeout in jiffies //
+// waits are killable so a stuck holder cannot hang its waiters for good //
+static long waitObjectLock(struct container* ctrNode, struct object* obj, long timeout)
+{
+	DEFINE_WAIT(wait);
+	long ret = 0, slice;
+
+	for(;;)
+	{
+		prepare_to_wait_exclusive(&obj->lock_wait, &wait, TASK_KILLABLE);
+		if(tryLockObject(obj))
+		{
+			break;
+		}
+		if(fatal_signal_pending(current))
+		{
+			ret = -EINTR;
+			break;
+		}
+		if(timeout == 0)
+		{
+			ret = -ETIMEDOUT;
+			break;
+		}
+		//a holder that exits without unlocking wakes nobody, so look now and then
+		slice = min_t(long, timeout, LOCK_CHECK_JIFFIES);
+		slice -= schedule_timeout(slice);
+		if(timeout != MAX_SCHEDULE_TIMEOUT)
+		{
+			timeout -= slice;
+		}
+		if(takeOverObject(ctrNode, obj))
+		{
+			break;
+		}
+	}
+	finish_wait(&obj->lock_wait, &wait);
+
+	//an exclusive wakeup we consumed without taking the lock goes to the next waiter
+	if(ret < 0 && READ_ONCE(obj->owner) == NULL)
+	{
+		wake_up(&obj->lock_wait);
+	}
+	return ret;
+}
+
+// taking the lock of an object: timeout in jiffies, MAX_SCHEDULE_TIMEOUT //
+// waits for good and 0 only tries //
+static long lockObject(struct container* ctrNode, struct object* obj, long timeout)
+{
+	long ret;
+
+	if(READ_ONCE(obj->owner) == current)
+	{
+		return -EDEADLK;
+	}
+	if(tryLockObject(obj) || spinOnOwner(obj) || takeOverObject(ctrNode, obj))
+	{
+		ret = 0;
+	}
+	else if(timeout == 0)
+	{
+		ret = -EBUSY;
+	}
+	else
+	{
+		ret = waitObjectLock(ctrNode, obj, timeout);
+	}
+	if(ret == 0)
+	{
+		WRITE_ONCE(obj->atime, jiffies);
+		seqWriteBegin(ctrNode, obj->oid);
+	}
+	return ret;
+}
+
+static int unlockObject(struct container* ctrNode, struct object* obj)
+{
+	if(READ_ONCE(obj->owner) != current)
+	{
+		return -EPERM;
+	}
+	seqWriteEnd(ctrNode, obj->oid);
+	smp_store_release(&obj->owner, NULL);
+	put_task_struct(current);
+	wake_up(&obj->lock_wait);
+	notifyObject(ctrNode, obj->oid, MCONTAINER_EVENT_UNLOCK);
+	return 0;
+}
+
+// lock wait from a command: MCONTAINER_OP_TIMEOUT bounds it by arg nanoseconds //
+static long lockTimeout(struct memory_container_cmd* ctrCmd)
+{
+	if(!(ctrCmd->op & MCONTAINER_OP_TIMEOUT))
+	{
+		return MAX_SCHEDULE_TIMEOUT;
+	}
+	if(ctrCmd->arg == 0)
+	{
+		return 0;
+	}
+	return max_t(unsigned long, nsecs_to_jiffies(ctrCmd->arg), 1);
+}
+
+//Locking function: with MCONTAINER_OP_TIMEOUT, arg bounds the wait in
+//nanoseconds and 0 only tries the lock
+int memory_container_lock(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct object* obj;
+	long ret;
+
+	//printk("\nLocking..... \n");	
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+	obj = getObjectRef(ctrNode, ctrCmd.oid, 1);
+	if(obj == NULL)
+	{
+		putContainer(ctrNode);
+		return -ENOMEM;
+	}
+	ret = lockObject(ctrNode, obj, lockTimeout(&ctrCmd));
+	putObject(obj);
+	putContainer(ctrNode);
+    return ret;
+}
+
+//Unlocking function
+int memory_container_unlock(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct object* obj;
+	int ret;
+
+	//printk("\nUnlocking..... \n");	
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+	obj = getObjectRef(ctrNode, ctrCmd.oid, 0);
+	if(obj == NULL)
+	{
+		putContainer(ctrNode);
+		return -ENOENT;
+	}
+	ret = unlockObject(ctrNode, obj);
+	putIdleObject(ctrNode, obj);
+	putContainer(ctrNode);
+    return ret;
+}
+
+// copying, sorting and deduplicating an oid array from user space //
+static __u64* getOidArray(struct memory_container_cmd* ctrCmd, unsigned long* count)
+{
+	unsigned long i, n = 0;
+	__u64* oids;
+
+	if(ctrCmd->count == 0 || ctrCmd->count > LOCK_MANY_MAX)
+	{
+		return ERR_PTR(-EINVAL);
+	}
+	oids = allocArray(ctrCmd->count * sizeof(__u64));
+	if(oids == NULL)
+	{
+		return ERR_PTR(-ENOMEM);
+	}
+	if(copy_from_user(oids, (void __user *)ctrCmd->arg, ctrCmd->count * sizeof(__u64)))
+	{
+		kvfree(oids);
+		return ERR_PTR(-EFAULT);
+	}
+	sort(oids, ctrCmd->count, sizeof(__u64), compareOid, NULL);
+	for(i = 0; i < ctrCmd->count; i++)
+	{
+		if(n == 0 || oids[n - 1] != oids[i])
+		{
+			oids[n++] = oids[i];
+		}
+	}
+	*count = n;
+	return oids;
+}
+
+//Multi-object locking function: takes the locks of count objects (oids at
+//arg) in ascending oid order, so concurrent callers cannot deadlock, and
+//either returns holding all of them or releases the ones it took
+int memory_container_lock_many(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct object** objs;
+	struct object* obj;
+	unsigned long count, i, deadline;
+	long timeout;
+	__u64* oids;
+	long ret = 0;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+	oids = getOidArray(&ctrCmd, &count);
+	if(IS_ERR(oids))
+	{
+		putContainer(ctrNode);
+		return PTR_ERR(oids);
+	}
+	objs = allocArray(count * sizeof(struct object*));
+	if(objs == NULL)
+	{
+		kvfree(oids);
+		putContainer(ctrNode);
+		return -ENOMEM;
+	}
+
+	timeout = lockTimeout(&ctrCmd);
+	deadline = jiffies + timeout;
+	for(i = 0; i < count; i++)
+	{
+		obj = getObjectRef(ctrNode, oids[i], 1);
+		if(obj == NULL)
+		{
+			ret = -ENOMEM;
+			break;
+		}
+		//one deadline for the whole set
+		if(timeout != MAX_SCHEDULE_TIMEOUT && timeout != 0)
+		{
+			timeout = time_after(deadline, jiffies) ? deadline - jiffies : 1;
+		}
+		ret = lockObject(ctrNode, obj, timeout);
+		if(ret < 0)
+		{
+			putIdleObject(ctrNode, obj);
+			break;
+		}
+		objs[i] = obj;
+	}
+	if(ret < 0)
+	{
+		while(i-- > 0)
+		{
+			unlockObject(ctrNode, objs[i]);
+		}
+	}
+	//objects created for a set that was given up go again
+	for(i = 0; i < count && objs[i] != NULL; i++)
+	{
+		putIdleObject(ctrNode, objs[i]);
+	}
+	kvfree(objs);
+	kvfree(oids);
+	putContainer(ctrNode);
+	return ret;
+}
+
+//Multi-object unlocking function: releases every listed lock held by the
+//caller, returns the first error
+int memory_container_unlock_many(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct object* obj;
+	unsigned long count, i;
+	__u64* oids;
+	int err, ret = 0;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+	oids = getOidArray(&ctrCmd, &count);
+	if(IS_ERR(oids))
+	{
+		putContainer(ctrNode);
+		return PTR_ERR(oids);
+	}
+	for(i = 0; i < count; i++)
+	{
+		obj = getObjectRef(ctrNode, oids[i], 0);
+		err = obj == NULL ? -ENOENT : unlockObject(ctrNode, obj);
+		if(obj != NULL)
+		{
+			putIdleObject(ctrNode, obj);
+		}
+		if(ret == 0)
+		{
+			ret = err;
+		}
+	}
+	kvfree(oids);
+	putContainer(ctrNode);
+	return ret;
+}
+
+//Deletion function
+int memory_container_delete(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+    	struct container* ctrNode = NULL;
+    	struct task** link;
+    	struct task* temp;
+
+    	copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd));
+	if(ctrCmd.op & MCONTAINER_OP_BIND)
+	{
+		return unbindContainer(filp);
+	}
+	//printk("\n\n");
+    	//printk( "try to take lock %d \n",current->pid);
+    	mutex_lock(&my_mutex);
+    	//printk( "Attained lock %d \n",current->pid);
+    
+    	//printk( "Delete called Container with cid = %llu \n",ctrCmd.cid);
+	
+	//get the container for current running process
+	ctrNode = getContainer(current);
+	
+    	if(ctrNode == NULL )
+	{
+        	//printk( "Container not found %llu \n",ctrNode->cid);
+        	//printk( "releasing lock %d",current->pid);
+        	mutex_unlock(&my_mutex);
+        	return 0;
+    	}
+      	//printk( "Delete: Container found %llu \n",ctrNode->cid);
+
+	for(link = &ctrNode->task_list; *link != NULL; link = &(*link)->next)
+	{
+		if((*link)->thread == current)
+		{
+			temp = *link;
+			RCU_INIT_POINTER(*link, temp->next);
+			freeTask(temp);
+			//the last one out tears the container down
+			leaveContainer(ctrNode, 1);
+			break;
+		}
+	}
+	putContainer(ctrNode);
+	//printk( "releasing lock %d \n",current->pid);
+	mutex_unlock(&my_mutex);
+    return 0;
+}
+
+//Creation function
+int memory_container_create(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct container* ctrNode = NULL;
+	struct task* tn= NULL;
+	struct task* temp= NULL;
+	int dropped;
+
+
+	struct memory_container_cmd ctrCmd;
+	copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd));
+	if(ctrCmd.op & MCONTAINER_OP_BIND)
+	{
+		return bindContainer(filp, ctrCmd.cid);
+	}
+	
+	//printk("Try to take the lock %d \n", current->pid);
+	mutex_lock(&my_mutex);
+	//printk("Attained lock %d \n", current->pid);
+
+	ctrNode = getContainerFromCid(ctrCmd.cid);
+	
+	if(ctrNode != NULL)
+	{
+		//printk("Container exists %llu \n", ctrNode->cid);
+
+		tn = getNewTask(filp);
+		//printk("\n after getNewtask!\n");
+		
+		if(tn == NULL)
+		{
+			//printk("releasing the lock, task not created %d \n", current->pid);
+			mutex_unlock(&my_mutex);
+			return 0;
+		}
+
+		ctrNode->task_cnt +=1;
+
+		//Adding task to the list
+
+		if(ctrNode->task_list == NULL)
+		{
+			//printk("tasks added at start.\n");
+			rcu_assign_pointer(ctrNode->task_list, tn);
+		}
+		else
+		{
+			//printk("task added at last.\n");
+			tn->next = ctrNode->task_list;
+			rcu_assign_pointer(ctrNode->task_list, tn);
+		}	
+	}
+	else
+	{
+		//printk("Container Not Found %llu, creating a new container... \n", ctrCmd.cid);
+		ctrNode = getNewContainer(ctrCmd.cid);
+
+		if(ctrNode == NULL)
+		{
+			//printk("getNewContainer failed %llu \n", ctrCmd.cid);
+			//printk("releasing lock %d", current->pid);
+			mutex_unlock(&my_mutex);
+			return 0;
+		}
+	
+		//printk("creating new task for the container.... %llu \n", ctrCmd.cid);
+		
+		tn = getNewTask(filp);
+
+		if(tn == NULL)
+		{
+			//printk("getNewTask Failed %llu... \n", ctrCmd.cid);
+			//printk("releasing the lock.... %d", current->pid);
+			putContainer(ctrNode);
+			mutex_unlock(&my_mutex);
+			return 0;
+		}
+		
+		ctrNode->task_list = tn;
+
+		if(ctr_list ==  NULL)
+		{
+			//printk("Adding the first container %llu..... \n", ctrCmd.cid);
+			rcu_assign_pointer(ctr_list, ctrNode);
+		}
+		else
+		{
+			//printk("Adding additional container %llu..... \n", ctrCmd.cid);
+			ctrNode->next = ctr_list;
+			rcu_assign_pointer(ctr_list, ctrNode);
+		}
+	}
+	//members that exited without deleting themselves are dropped as others join
+	dropped = dropTasks(ctrNode, NULL, true);
+	if(dropped > 0)
+	{
+		leaveContainer(ctrNode, dropped);
+	}
+	//printk("releasing the lock %d", current->pid);
+	mutex_unlock(&my_mutex);
+
+    return 0;
+}
+
+
+//Memory free function
+int memory_container_free(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;	
+	struct container* ctrNode;
+	struct object* temp_ref;
+
+	copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd));
+
+	//printk("Inside free().... \n");
+	
+	ctrNode = fileContainer(filp);
+
+	if(ctrNode == NULL)	
+	{
+		//printk("No Container exists... \n");
+		return 0;
+	}
+	if(ctrCmd.oid == MCONTAINER_SLAB_OID)
+	{
+		putContainer(ctrNode);
+		return -EINVAL;
+	}
+	if(slabFree(ctrNode, ctrCmd.oid))
+	{
+		notifyObject(ctrNode, ctrCmd.oid, MCONTAINER_EVENT_FREE);
+	}
+
+	//the object stays linked while locked or mapped, the lock has to outlive the free
+	temp_ref = getObjectRef(ctrNode, ctrCmd.oid, 0);
+	if(temp_ref != NULL)
+	{
+		//revoke the pages from every task still mapping the object
+		mutex_lock(&temp_ref->page_mutex);
+		resizePages(temp_ref, 0);
+		temp_ref->flags &= ~OBJ_IMPORTED;
+		if(temp_ref->backing != NULL)
+		{
+			fput(temp_ref->backing);
+			temp_ref->backing = NULL;
+		}
+		mutex_unlock(&temp_ref->page_mutex);
+		notifyObject(ctrNode, temp_ref->oid, MCONTAINER_EVENT_FREE);
+		putIdleObject(ctrNode, temp_ref);
+	}
+	putContainer(ctrNode);
+    return 0;
+}
+
+//Small object allocation: packs the object into the slab and returns its
+//offset there in arg, 1 if the chunk is new and 0 if oid already had one
+int memory_container_alloc_small(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct slab* sl;
+	struct slabEntry* e;
+	__u64 offset;
+	int c;
+	int ret = 0;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	if(ctrCmd.size == 0 || ctrCmd.size > MCONTAINER_SMALL_MAX || ctrCmd.oid >= MCONTAINER_SLAB_OID)
+	{
+		return -EINVAL;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+	sl = &ctrNode->slab;
+	c = slabClass(ctrCmd.size);
+
+	mutex_lock(&sl->mutex);
+	if(sl->obj == NULL)
+	{
+		sl->obj = getObjectRef(ctrNode, MCONTAINER_SLAB_OID, 1);
+		if(sl->obj == NULL)
+		{
+			mutex_unlock(&sl->mutex);
+			putContainer(ctrNode);
+			return -ENOMEM;
+		}
+	}
+	e = slabLookup(sl, ctrCmd.oid);
+	if(e != NULL)
+	{
+		//a bigger size needs the object freed first
+		offset = SLAB_OFFSET(e->where);
+		ret = SLAB_CLASS(e->where) < c ? -EEXIST : 0;
+	}
+	else
+	{
+		ret = slabChunk(sl, c, &offset);
+		if(ret == 0)
+		{
+			ret = slabInsert(sl, ctrCmd.oid, offset | SLAB_USED | c);
+			if(ret < 0)
+			{
+				slabPutChunk(sl, c, offset);
+			}
+		}
+		ret = ret < 0 ? ret : 1;
+	}
+	mutex_unlock(&sl->mutex);
+	putContainer(ctrNode);
+
+	if(ret >= 0 && put_user(offset, &user_cmd->arg))
+	{
+		return -EFAULT;
+	}
+	return ret;
+}
+
+//Resize function: grows or shrinks an object in place
+int memory_container_resize(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct object* obj;
+	unsigned long npages;
+	int ret;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	npages = PAGE_ALIGN(ctrCmd.size) >> PAGE_SHIFT;
+	if(npages > PAGE_INDEX_MASK + 1)
+	{
+		return -EFBIG;
+	}
+
+	if(ctrCmd.oid == MCONTAINER_SLAB_OID)
+	{
+		return -EINVAL;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+
+	mutex_lock(&obj_mutex);
+	obj = getObject(ctrNode, ctrCmd.oid);
+	if(obj == NULL)
+	{
+		obj = getNewObject(ctrCmd.oid, 0);
+		if(obj == NULL)
+		{
+			mutex_unlock(&obj_mutex);
+			putContainer(ctrNode);
+			return -ENOMEM;
+		}
+		addObject(ctrNode, obj);
+	}
+	kref_get(&obj->ref);
+	mutex_unlock(&obj_mutex);
+	putContainer(ctrNode);
+
+	mutex_lock(&obj->page_mutex);
+	ret = resizePages(obj, npages);
+	mutex_unlock(&obj->page_mutex);
+	putObject(obj);
+	return ret;
+}
+
+// handing the backing of src over to the empty dst, both page_mutexes held //
+// src is left empty like a freed object: tasks still mapping it are revoked //
+// and fault with SIGBUS, so only mappings of dst reach the pages afterwards //
+static void moveBacking(struct object* src, struct object* dst)
+{
+	if(src->mapping != NULL)
+	{
+		unmap_mapping_range(src->mapping, objectOffset(src), (loff_t)src->npages << PAGE_SHIFT, 1);
+	}
+	kvfree(dst->pages);
+	kvfree(dst->cow);
+	kvfree(dst->dirty);
+	kvfree(dst->hashed);
+	kvfree(dst->hashes);
+	dst->pages = src->pages;
+	dst->npages = src->npages;
+	dst->cow = src->cow;
+	dst->dirty = src->dirty;
+	dst->hashed = src->hashed;
+	dst->hashes = src->hashes;
+	dst->flags |= src->flags & OBJ_IMPORTED;
+	dst->backing = src->backing;
+	dst->backing_offset = src->backing_offset;
+	dst->zpages = src->zpages;
+	dst->nzpages = src->nzpages;
+	dst->zbytes = src->zbytes;
+	dst->atime = jiffies;
+
+	src->pages = NULL;
+	src->npages = 0;
+	src->cow = NULL;
+	src->dirty = NULL;
+	src->hashed = NULL;
+	src->hashes = NULL;
+	src->flags &= ~OBJ_IMPORTED;
+	src->backing = NULL;
+	INIT_RADIX_TREE(&src->zpages, GFP_KERNEL);
+	src->nzpages = 0;
+	src->zbytes = 0;
+}
+
+// iterate_fd callback: a file of this module bound to the container //
+static int fileBoundTo(const void* ctr, struct file* file, unsigned fd)
+{
+	struct fileState* state;
+
+	if(file->f_op->release != memory_container_release)
+	{
+		return 0;
+	}
+	state = file->private_data;
+	return READ_ONCE(state->ctr) == ctr;
+}
+
+// a task is in a container it joined or one it holds a bound file of //
+static bool isMember(struct container* ctrNode)
+{
+	struct container* own = getContainer(current);
+
+	if(own != NULL)
+	{
+		putContainer(own);
+	}
+	return own == ctrNode || iterate_fd(current->files, 0, fileBoundTo, ctrNode) != 0;
+}
+
+//Move function: hands the backing of object oid of the current container
+//over to object arg of container cid without copying. The target must not
+//have backing and the object must not be locked
+int memory_container_move(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct container* dstNode;
+	struct object* obj;
+	struct object* dst = NULL;
+	int ret = 0;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	if(ctrCmd.oid == MCONTAINER_SLAB_OID || ctrCmd.arg == MCONTAINER_SLAB_OID)
+	{
+		return -EINVAL;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+
+	mutex_lock(&my_mutex);
+	dstNode = getContainerFromCid(ctrCmd.cid);
+	if(dstNode != NULL)
+	{
+		kref_get(&dstNode->ref);
+	}
+	mutex_unlock(&my_mutex);
+	if(dstNode == NULL)
+	{
+		putContainer(ctrNode);
+		return -ENOENT;
+	}
+	if(!isMember(dstNode))
+	{
+		putContainer(dstNode);
+		putContainer(ctrNode);
+		return -EPERM;
+	}
+
+	obj = getObjectRef(ctrNode, ctrCmd.oid, 0);
+	if(obj != NULL)
+	{
+		dst = getObjectRef(dstNode, ctrCmd.arg, 1);
+	}
+	if(obj == NULL)
+	{
+		ret = -ENOENT;
+		goto out;
+	}
+	if(dst == NULL)
+	{
+		ret = -ENOMEM;
+		goto out;
+	}
+	if(dst == obj)
+	{
+		goto out;
+	}
+	//the object lock is held across the move, like a writer's
+	if(cmpxchg(&obj->owner, NULL, current) != NULL)
+	{
+		ret = -EBUSY;
+		goto out;
+	}
+	seqWriteBegin(ctrNode, obj->oid);
+
+	//the two page_mutexes are always taken in address order
+	if(obj < dst)
+	{
+		mutex_lock(&obj->page_mutex);
+		mutex_lock_nested(&dst->page_mutex, SINGLE_DEPTH_NESTING);
+	}
+	else
+	{
+		mutex_lock(&dst->page_mutex);
+		mutex_lock_nested(&obj->page_mutex, SINGLE_DEPTH_NESTING);
+	}
+	if(dst->npages != 0)
+	{
+		ret = -EEXIST;
+	}
+	else
+	{
+		moveBacking(obj, dst);
+	}
+	mutex_unlock(&obj->page_mutex);
+	mutex_unlock(&dst->page_mutex);
+	seqWriteEnd(ctrNode, obj->oid);
+	smp_store_release(&obj->owner, NULL);
+	wake_up(&obj->lock_wait);
+	if(ret == 0)
+	{
+		notifyObject(ctrNode, obj->oid, MCONTAINER_EVENT_FREE);
+	}
+
+out:
+	if(obj != NULL)
+	{
+		putIdleObject(ctrNode, obj);
+	}
+	if(dst != NULL)
+	{
+		putObject(dst);
+	}
+	putContainer(dstNode);
+	putContainer(ctrNode);
+	return ret;
+}
+
+// taking a reference on every object of a container, so they can be //
+// walked without holding obj_mutex //
+static struct object** getObjectArray(struct container* ctrNode, unsigned long* count)
+{
+	struct object** objs;
+	struct object* obj;
+	unsigned long n = 0;
+
+	mutex_lock(&obj_mutex);
+	for(obj = ctrNode->obj; obj != NULL; obj = obj->next)
+	{
+		n++;
+	}
+	objs = allocArray(n * sizeof(struct object*));
+	if(objs != NULL)
+	{
+		n = 0;
+		for(obj = ctrNode->obj; obj != NULL; obj = obj->next)
+		{
+			kref_get(&obj->ref);
+			objs[n++] = obj;
+		}
+	}
+	mutex_unlock(&obj_mutex);
+	*count = n;
+	return objs;
+}
+
+// sharing the pages of src with dst, page_mutex of src held //
+// imported pages are copied: writes to them must keep reaching their owner //
+static int snapshotObject(struct object* src, struct object* dst)
+{
+	unsigned long i;
+
+	kvfree(dst->pages);
+	dst->pages = allocPageArray(src->npages);
+	dst->cow = allocPageBitmap(src->npages);
+	if(src->cow == NULL)
+	{
+		src->cow = allocPageBitmap(src->npages);
+	}
+	if(dst->pages == NULL || dst->cow == NULL || src->cow == NULL)
+	{
+		return -ENOMEM;
+	}
+	for(i = 0; i < src->npages; i++)
+	{
+		if(src->flags & OBJ_IMPORTED)
+		{
+			dst->pages[i] = alloc_page(GFP_KERNEL);
+			if(dst->pages[i] == NULL)
+			{
+				return -ENOMEM;
+			}
+			copy_highpage(dst->pages[i], src->pages[i]);
+		}
+		else
+		{
+			if(loadPage(src, i) < 0)
+			{
+				return -EIO;
+			}
+			get_page(src->pages[i]);
+			dst->pages[i] = src->pages[i];
+			set_bit(i, src->cow);
+			set_bit(i, dst->cow);
+		}
+		dst->npages = i + 1;
+	}
+
+	//existing writable ptes of the source have to fault again
+	if(src->mapping != NULL && !(src->flags & OBJ_IMPORTED))
+	{
+		unmap_mapping_range(src->mapping, objectOffset(src), (loff_t)src->npages << PAGE_SHIFT, 1);
+	}
+	return 0;
+}
+
+//Snapshot function: creates container cid as a copy-on-write image of
+//container arg, which the caller has to be a member of. The new container
+//has no tasks until one joins with create
+int memory_container_snapshot(struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* src;
+	struct container* dst;
+	struct object** objs;
+	struct object* copy;
+	unsigned long count, i;
+	int ret = 0;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+
+	mutex_lock(&my_mutex);
+	src = getContainerFromCid(ctrCmd.arg);
+	if(src == NULL)
+	{
+		ret = -ENOENT;
+	}
+	else if(getContainerFromCid(ctrCmd.cid) != NULL)
+	{
+		ret = -EEXIST;
+	}
+	else
+	{
+		kref_get(&src->ref);
+	}
+	mutex_unlock(&my_mutex);
+	if(ret < 0)
+	{
+		return ret;
+	}
+	if(!isMember(src))
+	{
+		putContainer(src);
+		return -EPERM;
+	}
+	dst = getNewContainer(ctrCmd.cid);
+	if(dst == NULL)
+	{
+		putContainer(src);
+		return -ENOMEM;
+	}
+	dst->task_cnt = 0;
+
+	//the pages are shared without my_mutex or obj_mutex held, so other
+	//containers go on meanwhile; the slab layout has to match its pages
+	mutex_lock(&src->slab.mutex);
+	objs = getObjectArray(src, &count);
+	if(objs == NULL)
+	{
+		ret = -ENOMEM;
+	}
+	for(i = 0; objs != NULL && i < count; i++)
+	{
+		if(ret == 0)
+		{
+			copy = getNewObject(objs[i]->oid, 0);
+			if(copy == NULL)
+			{
+				ret = -ENOMEM;
+			}
+			else
+			{
+				mutex_lock(&obj_mutex);
+				addObject(dst, copy);
+				mutex_unlock(&obj_mutex);
+				mutex_lock(&objs[i]->page_mutex);
+				ret = snapshotObject(objs[i], copy);
+				mutex_unlock(&objs[i]->page_mutex);
+			}
+			cond_resched();
+		}
+		putObject(objs[i]);
+	}
+	kvfree(objs);
+	if(ret == 0)
+	{
+		ret = slabCopy(dst, &src->slab);
+	}
+	mutex_unlock(&src->slab.mutex);
+	putContainer(src);
+
+	//cid may have been taken while the pages were shared
+	mutex_lock(&my_mutex);
+	if(ret == 0 && getContainerFromCid(ctrCmd.cid) != NULL)
+	{
+		ret = -EEXIST;
+	}
+	if(ret == 0)
+	{
+		dst->next = ctr_list;
+		rcu_assign_pointer(ctr_list, dst);
+	}
+	mutex_unlock(&my_mutex);
+	if(ret < 0)
+	{
+		putContainer(dst);
+	}
+	return ret;
+}
+
+// writing the pages of one object at pos, page_mutex held //
+static int checkpointObject(struct object* obj, struct file* file, loff_t pos)
+{
+	unsigned long i;
+	ssize_t written;
+	void* addr;
+
+	for(i = 0; i < obj->npages; i++)
+	{
+		if(loadPage(obj, i) < 0)
+		{
+			return -EIO;
+		}
+		addr = kmap(obj->pages[i]);
+		written = kernel_write(file, addr, PAGE_SIZE, pos + ((loff_t)i << PAGE_SHIFT));
+		kunmap(obj->pages[i]);
+		if(written != PAGE_SIZE)
+		{
+			return written < 0 ? written : -EIO;
+		}
+	}
+	return 0;
+}
+
+//Checkpoint function: writes every object of the current container to
+//the file arg. Objects are written as they are, writers should be quiesced
+int memory_container_checkpoint(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct mcontainer_checkpoint_header header;
+	struct mcontainer_checkpoint_entry* entries = NULL;
+	struct container* ctrNode;
+	struct object** objs;
+	struct file* file;
+	unsigned long count, i, n;
+	size_t index_size;
+	loff_t pos;
+	int ret = 0;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+	//small objects cannot be restored: their layout lives in the module, not in the pages
+	mutex_lock(&ctrNode->slab.mutex);
+	ret = ctrNode->slab.live ? -EOPNOTSUPP : 0;
+	mutex_unlock(&ctrNode->slab.mutex);
+	file = ret < 0 ? NULL : fget(ctrCmd.arg);
+	if(file == NULL)
+	{
+		putContainer(ctrNode);
+		return ret < 0 ? ret : -EBADF;
+	}
+
+	objs = getObjectArray(ctrNode, &count);
+	putContainer(ctrNode);
+	if(objs != NULL)
+	{
+		//the slab object itself, with only freed chunks left, is skipped
+		for(i = 0, n = 0; i < count; i++)
+		{
+			if(objs[i]->oid == MCONTAINER_SLAB_OID)
+			{
+				putObject(objs[i]);
+			}
+			else
+			{
+				objs[n++] = objs[i];
+			}
+		}
+		count = n;
+		entries = allocArray(count * sizeof(struct mcontainer_checkpoint_entry));
+	}
+	if(objs == NULL || entries == NULL)
+	{
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	//the index goes first but is only written once every object is out
+	index_size = sizeof(header) + count * sizeof(struct mcontainer_checkpoint_entry);
+	pos = PAGE_ALIGN(index_size);
+	for(i = 0; i < count && ret == 0; i++)
+	{
+		mutex_lock(&objs[i]->page_mutex);
+		entries[i].oid = objs[i]->oid;
+		entries[i].npages = objs[i]->npages;
+		entries[i].offset = pos;
+		ret = checkpointObject(objs[i], file, pos);
+		pos += (loff_t)objs[i]->npages << PAGE_SHIFT;
+		mutex_unlock(&objs[i]->page_mutex);
+	}
+	if(ret == 0)
+	{
+		header.magic = MCONTAINER_CHECKPOINT_MAGIC;
+		header.count = count;
+		if(kernel_write(file, (char*)&header, sizeof(header), 0) != sizeof(header) ||
+		   kernel_write(file, (char*)entries, index_size - sizeof(header), sizeof(header)) != index_size - sizeof(header))
+		{
+			ret = -EIO;
+		}
+	}
+
+out:
+	for(i = 0; objs != NULL && i < count; i++)
+	{
+		putObject(objs[i]);
+	}
+	kvfree(objs);
+	kvfree(entries);
+	fput(file);
+	return ret;
+}
+
+//Restore function: recreates the objects of a checkpoint in the current
+//container. Only the index is read; pages come in from the file on first touch
+int memory_container_restore(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct mcontainer_checkpoint_header header;
+	struct mcontainer_checkpoint_entry* entries = NULL;
+	struct container* ctrNode;
+	struct object* obj;
+	struct page** pages;
+	unsigned long* cow;
+	struct file* file;
+	size_t index_size;
+	unsigned long i;
+	int ret = 0;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+	file = fget(ctrCmd.arg);
+	if(file == NULL)
+	{
+		putContainer(ctrNode);
+		return -EBADF;
+	}
+
+	if(kernel_read(file, 0, (char*)&header, sizeof(header)) != sizeof(header) ||
+	   header.magic != MCONTAINER_CHECKPOINT_MAGIC ||
+	   header.count > i_size_read(file_inode(file)) / sizeof(struct mcontainer_checkpoint_entry))
+	{
+		ret = -EINVAL;
+		goto out;
+	}
+	index_size = header.count * sizeof(struct mcontainer_checkpoint_entry);
+	entries = allocArray(index_size);
+	if(entries == NULL)
+	{
+		ret = -ENOMEM;
+		goto out;
+	}
+	if(kernel_read(file, sizeof(header), (char*)entries, index_size) != index_size)
+	{
+		ret = -EIO;
+		goto out;
+	}
+
+	for(i = 0; i < header.count && ret == 0; i++)
+	{
+		if(entries[i].npages > PAGE_INDEX_MASK + 1 || (entries[i].offset & ~PAGE_MASK))
+		{
+			ret = -EINVAL;
+			break;
+		}
+		pages = allocPageArray(entries[i].npages);
+		cow = allocPageBitmap(entries[i].npages);
+		obj = getObjectRef(ctrNode, entries[i].oid, 1);
+		if(pages == NULL || cow == NULL || obj == NULL)
+		{
+			ret = -ENOMEM;
+		}
+		else
+		{
+			mutex_lock(&obj->page_mutex);
+			if(obj->npages != 0)
+			{
+				ret = -EEXIST;
+			}
+			else
+			{
+				kvfree(obj->pages);
+				kvfree(obj->cow);
+				obj->pages = pages;
+				obj->cow = cow;
+				obj->npages = entries[i].npages;
+				obj->backing = get_file(file);
+				obj->backing_offset = entries[i].offset;
+				pages = NULL;
+				cow = NULL;
+			}
+			mutex_unlock(&obj->page_mutex);
+		}
+		if(obj != NULL)
+		{
+			putObject(obj);
+		}
+		kvfree(pages);
+		kvfree(cow);
+	}
+
+out:
+	kvfree(entries);
+	fput(file);
+	putContainer(ctrNode);
+	return ret;
+}
+
+// write-protecting every mapped page of an object, page_mutex held //
+static void writeProtectObject(struct object* obj)
+{
+	if(obj->mapping != NULL && obj->npages != 0)
+	{
+		unmap_mapping_range(obj->mapping, objectOffset(obj), (loff_t)obj->npages << PAGE_SHIFT, 1);
+	}
+}
+
+//Dirty tracking function: turns tracking for the current container on (op != 0)
+//or off. Pages mapped writable before tracking starts are write-protected again
+int memory_container_track_dirty(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct object* obj;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+
+	mutex_lock(&obj_mutex);
+	if(ctrCmd.op)
+	{
+		ctrNode->flags |= CTR_TRACK_DIRTY;
+	}
+	else
+	{
+		ctrNode->flags &= ~CTR_TRACK_DIRTY;
+	}
+	for(obj = ctrNode->obj; obj != NULL; obj = obj->next)
+	{
+		mutex_lock(&obj->page_mutex);
+		if(ctrCmd.op)
+		{
+			obj->flags |= OBJ_TRACK_DIRTY;
+			writeProtectObject(obj);
+		}
+		else
+		{
+			obj->flags &= ~OBJ_TRACK_DIRTY;
+			kvfree(obj->dirty);
+			obj->dirty = NULL;
+		}
+		mutex_unlock(&obj->page_mutex);
+	}
+	mutex_unlock(&obj_mutex);
+	putContainer(ctrNode);
+	return 0;
+}
+
+//Dirty collection function: copies the dirty bitmap of one object to arg
+//(count bits at most, bit i of 64-bit word i/64 for page i) and clears it.
+//Returns the number of pages of the object
+int memory_container_collect_dirty(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct object* obj;
+	unsigned long nlongs;
+	long ret;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+
+	mutex_lock(&obj_mutex);
+	obj = getObject(ctrNode, ctrCmd.oid);
+	if(obj != NULL)
+	{
+		kref_get(&obj->ref);
+	}
+	mutex_unlock(&obj_mutex);
+	putContainer(ctrNode);
+	if(obj == NULL)
+	{
+		return -ENOENT;
+	}
+
+	mutex_lock(&obj->page_mutex);
+	ret = obj->npages;
+	nlongs = BITS_TO_LONGS(min_t(unsigned long, ctrCmd.count, obj->npages));
+	//revoke first: every write that lands after this faults and is recorded
+	//again, every write before it is already in the bitmap
+	writeProtectObject(obj);
+	if(obj->dirty == NULL)
+	{
+		if(clear_user((void __user *)ctrCmd.arg, nlongs * sizeof(unsigned long)))
+		{
+			ret = -EFAULT;
+		}
+	}
+	else if(copy_to_user((void __user *)ctrCmd.arg, obj->dirty, nlongs * sizeof(unsigned long)))
+	{
+		ret = -EFAULT;
+	}
+	else
+	{
+		memset(obj->dirty, 0, BITS_TO_LONGS(obj->npages) * sizeof(unsigned long));
+	}
+	mutex_unlock(&obj->page_mutex);
+	putObject(obj);
+	return ret;
+}
+
+//Dedup: identical pages of a container are merged into one copy-on-write//
+//page, the same way a snapshot shares pages with its source. Hashes are//
+//kept per object; a pass only hashes pages written since the one before//
+
+struct dedupEntry
+{
+	u32 hash;
+	unsigned long index;
+	struct object* obj;
+	struct page* page;		//referenced while the pass runs
+};
+
+static int compareDedup(const void* a, const void* b)
+{
+	const struct dedupEntry* x = a;
+	const struct dedupEntry* y = b;
+
+	if(x->hash != y->hash)
+	{
+		return x->hash < y->hash ? -1 : 1;
+	}
+	return x->page < y->page ? -1 : x->page > y->page;
+}
+
+// marking the page of e copy-on-write and taking it away from every task //
+// so that writes fault in again; false if the object has moved on //
+static bool dedupProtect(struct dedupEntry* e)
+{
+	struct object* obj = e->obj;
+
+	if(e->index >= obj->npages || obj->pages[e->index] != e->page)
+	{
+		return false;
+	}
+	if(obj->cow == NULL)
+	{
+		obj->cow = allocPageBitmap(obj->npages);
+		if(obj->cow == NULL)
+		{
+			return false;
+		}
+	}
+	set_bit(e->index, obj->cow);
+	if(obj->mapping != NULL)
+	{
+		unmap_mapping_range(obj->mapping, objectOffset(obj) + ((loff_t)e->index << PAGE_SHIFT), PAGE_SIZE, 1);
+	}
+	return true;
+}
+
+// merging pages that hashed alike into the first one, returns how many went //
+static unsigned long dedupGroup(struct dedupEntry* entries, unsigned long n)
+{
+	struct page* keep = entries[0].page;
+	struct object* obj;
+	unsigned long merged = 0;
+	unsigned long k;
+	void* a;
+	void* b;
+	int same;
+
+	//once protected, keep only changes by being copied away from it
+	mutex_lock(&entries[0].obj->page_mutex);
+	same = dedupProtect(&entries[0]);
+	mutex_unlock(&entries[0].obj->page_mutex);
+	if(!same)
+	{
+		return 0;
+	}
+
+	for(k = 1; k < n; k++)
+	{
+		obj = entries[k].obj;
+		mutex_lock(&obj->page_mutex);
+		if(dedupProtect(&entries[k]))
+		{
+			a = kmap_atomic(keep);
+			b = kmap_atomic(entries[k].page);
+			same = memcmp(a, b, PAGE_SIZE) == 0;
+			kunmap_atomic(b);
+			kunmap_atomic(a);
+			if(same)
+			{
+				get_page(keep);
+				obj->pages[entries[k].index] = keep;
+				put_page(entries[k].page);
+				merged++;
+			}
+		}
+		mutex_unlock(&obj->page_mutex);
+	}
+	return merged;
+}
+
+// the dedup hash of a page, page_mutex held: recomputed only if the page //
+// was written or loaded since the last pass, and write-protected again so //
+// the next write clears it once more //
+static u32 dedupHash(struct object* obj, unsigned long index)
+{
+	void* addr;
+
+	if(!test_bit(index, obj->hashed))
+	{
+		if(obj->mapping != NULL)
+		{
+			unmap_mapping_range(obj->mapping, objectOffset(obj) + ((loff_t)index << PAGE_SHIFT), PAGE_SIZE, 1);
+		}
+		addr = kmap_atomic(obj->pages[index]);
+		obj->hashes[index] = jhash2(addr, PAGE_SIZE / sizeof(u32), 0);
+		kunmap_atomic(addr);
+		set_bit(index, obj->hashed);
+	}
+	return obj->hashes[index];
+}
+
+// one pass over the private pages of the container //
+static void dedupContainer(struct container* ctrNode)
+{
+	struct dedupEntry* entries = NULL;
+	struct object** objs;
+	struct object* obj;
+	struct page* page;
+	unsigned long count, npages = 0, n = 0, merged = 0;
+	unsigned long i, j;
+
+	objs = getObjectArray(ctrNode, &count);
+	if(objs == NULL)
+	{
+		return;
+	}
+	for(i = 0; i < count; i++)
+	{
+		npages += READ_ONCE(objs[i]->npages);
+	}
+	entries = allocArray(npages * sizeof(struct dedupEntry));
+	if(entries == NULL)
+	{
+		goto out;
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		obj = objs[i];
+		//imported pages are someone else's memory
+		if(obj->flags & OBJ_IMPORTED)
+		{
+			continue;
+		}
+		mutex_lock(&obj->page_mutex);
+		if(obj->hashed == NULL && obj->npages != 0)
+		{
+			obj->hashed = allocPageBitmap(obj->npages);
+			obj->hashes = allocArray(obj->npages * sizeof(u32));
+			if(obj->hashed == NULL || obj->hashes == NULL)
+			{
+				kvfree(obj->hashed);
+				kvfree(obj->hashes);
+				obj->hashed = NULL;
+				obj->hashes = NULL;
+				mutex_unlock(&obj->page_mutex);
+				continue;
+			}
+		}
+		for(j = 0; j < obj->npages && n < npages; j++)
+		{
+			page = obj->pages[j];
+			//skip pages not loaded yet and pages already shared
+			if(page == NULL || page_count(page) != 1)
+			{
+				continue;
+			}
+			entries[n].hash = dedupHash(obj, j);
+			entries[n].index = j;
+			entries[n].obj = obj;
+			entries[n].page = page;
+			get_page(page);
+			n++;
+		}
+		mutex_unlock(&obj->page_mutex);
+		cond_resched();
+	}
+
+	sort(entries, n, sizeof(struct dedupEntry), compareDedup, NULL);
+	for(i = 0; i < n; i = j)
+	{
+		for(j = i + 1; j < n && entries[j].hash == entries[i].hash; j++)
+		{
+		}
+		if(j - i > 1)
+		{
+			merged += dedupGroup(entries + i, j - i);
+			cond_resched();
+		}
+	}
+	atomic64_add(merged, &ctrNode->dedup_merged);
+
+	for(i = 0; i < n; i++)
+	{
+		put_page(entries[i].page);
+	}
+out:
+	for(i = 0; i < count; i++)
+	{
+		putObject(objs[i]);
+	}
+	kvfree(objs);
+	kvfree(entries);
+}
+
+static void dedupWork(struct work_struct *work)
+{
+	struct container* ctrNode = container_of(to_delayed_work(work), struct container, dedup_work);
+
+	dedupContainer(ctrNode);
+	if(READ_ONCE(ctrNode->flags) & CTR_DEDUP)
+	{
+		queue_delayed_work(system_unbound_wq, &ctrNode->dedup_work, msecs_to_jiffies(dedup_interval));
+	}
+}
+
+//Dedup function: op non-zero starts passes over the current container,
+//the first one right away; 0 stops them. Merged pages stay shared
+int memory_container_dedup(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	int ret = 0;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+
+	mutex_lock(&obj_mutex);
+	if(!(ctrNode->flags & CTR_DEDUP_READY))
+	{
+		INIT_DELAYED_WORK(&ctrNode->dedup_work, dedupWork);
+		ctrNode->flags |= CTR_DEDUP_READY;
+	}
+	if(ctrNode->flags & CTR_DESTROYED)
+	{
+		ret = -ENOENT;
+	}
+	else if(ctrCmd.op)
+	{
+		ctrNode->flags |= CTR_DEDUP;
+		mod_delayed_work(system_unbound_wq, &ctrNode->dedup_work, 0);
+	}
+	else
+	{
+		ctrNode->flags &= ~CTR_DEDUP;
+	}
+	mutex_unlock(&obj_mutex);
+	putContainer(ctrNode);
+	return ret;
+}
+
+//Compression: the private pages of objects nobody faulted on or locked for//
+//cold_age are compressed with lz4 and loaded back on the next fault//
+
+// transform and scratch space of one scan //
+struct compressBuffer
+{
+	struct crypto_comp* tfm;
+	unsigned char* dst;
+};
+
+static void compressObject(struct object* obj, struct compressBuffer* buf, unsigned long cold_age)
+{
+	struct zpage* zp;
+	struct page* page;
+	unsigned long i;
+	unsigned int len;
+	void* addr;
+	int err;
+
+	mutex_lock(&obj->page_mutex);
+	//imported pages are someone else's memory, a locked object is in use;
+	//a mapped one may be in use through ptes the age cannot see, so it is
+	//left alone rather than taken away and faulted back in every scan
+	if((obj->flags & OBJ_IMPORTED) || READ_ONCE(obj->owner) != NULL || atomic_read(&obj->nmaps) != 0 ||
+	   time_before(jiffies, obj->atime + cold_age))
+	{
+		mutex_unlock(&obj->page_mutex);
+		return;
+	}
+	for(i = 0; i < obj->npages; i++)
+	{
+		page = obj->pages[i];
+		//shared pages would only be duplicated
+		if(page == NULL || page_count(page) != 1 || (obj->cow != NULL && test_bit(i, obj->cow)))
+		{
+			continue;
+		}
+		len = ZBUF_SIZE;
+		addr = kmap_atomic(page);
+		err = crypto_comp_compress(buf->tfm, addr, PAGE_SIZE, buf->dst, &len);
+		kunmap_atomic(addr);
+		//not worth a fault for less than a quarter
+		if(err < 0 || len > PAGE_SIZE - PAGE_SIZE / 4)
+		{
+			continue;
+		}
+		zp = kmalloc(sizeof(struct zpage) + len, GFP_KERNEL);
+		if(zp == NULL)
+		{
+			break;
+		}
+		zp->len = len;
+		memcpy(zp->data, buf->dst, len);
+		if(radix_tree_insert(&obj->zpages, i, zp) < 0)
+		{
+			kfree(zp);
+			break;
+		}
+		obj->nzpages++;
+		obj->zbytes += len;
+		releasePage(obj, page);
+		obj->pages[i] = NULL;
+		cond_resched();
+	}
+	mutex_unlock(&obj->page_mutex);
+}
+
+static void compressWork(struct work_struct *work)
+{
+	struct container* ctrNode = container_of(to_delayed_work(work), struct container, compress_work);
+	unsigned long cold_age = READ_ONCE(ctrNode->cold_age);
+	struct compressBuffer buf;
+	struct object** objs;
+	unsigned long count, i;
+
+	buf.tfm = crypto_alloc_comp("lz4", 0, 0);
+	buf.dst = kmalloc(ZBUF_SIZE, GFP_KERNEL);
+	objs = getObjectArray(ctrNode, &count);
+	if(objs != NULL)
+	{
+		for(i = 0; i < count; i++)
+		{
+			if(!IS_ERR(buf.tfm) && buf.dst != NULL)
+			{
+				compressObject(objs[i], &buf, cold_age);
+			}
+			putObject(objs[i]);
+		}
+		kvfree(objs);
+	}
+	if(!IS_ERR(buf.tfm))
+	{
+		crypto_free_comp(buf.tfm);
+	}
+	kfree(buf.dst);
+
+	if(READ_ONCE(ctrNode->flags) & CTR_COMPRESS)
+	{
+		queue_delayed_work(system_unbound_wq, &ctrNode->compress_work, max(cold_age / 2, 1UL));
+	}
+}
+
+// the shared transform, allocated by the first compress call //
+static int getLz4(void)
+{
+	struct crypto_comp* tfm;
+	int ret = 0;
+
+	mutex_lock(&lz4_mutex);
+	if(lz4_tfm == NULL)
+	{
+		tfm = crypto_alloc_comp("lz4", 0, 0);
+		if(IS_ERR(tfm))
+		{
+			ret = -EOPNOTSUPP;
+		}
+		else
+		{
+			lz4_tfm = tfm;
+		}
+	}
+	mutex_unlock(&lz4_mutex);
+	return ret;
+}
+
+//Compress function: op is the age in ms after which untouched objects of
+//the current container are compressed, 0 stops the scans. Pages already
+//compressed stay so until they are faulted on. Objects mapped by a task
+//are not compressed. Fails with -EOPNOTSUPP if the kernel has no lz4
+int memory_container_compress(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	int ret = 0;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	if(ctrCmd.op)
+	{
+		ret = getLz4();
+		if(ret < 0)
+		{
+			return ret;
+		}
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+
+	mutex_lock(&obj_mutex);
+	if(!(ctrNode->flags & CTR_COMPRESS_READY))
+	{
+		INIT_DELAYED_WORK(&ctrNode->compress_work, compressWork);
+		ctrNode->flags |= CTR_COMPRESS_READY;
+	}
+	if(ctrNode->flags & CTR_DESTROYED)
+	{
+		ret = -ENOENT;
+	}
+	else if(ctrCmd.op)
+	{
+		WRITE_ONCE(ctrNode->cold_age, msecs_to_jiffies(ctrCmd.op));
+		ctrNode->flags |= CTR_COMPRESS;
+		mod_delayed_work(system_unbound_wq, &ctrNode->compress_work, ctrNode->cold_age);
+	}
+	else
+	{
+		ctrNode->flags &= ~CTR_COMPRESS;
+	}
+	mutex_unlock(&obj_mutex);
+	putContainer(ctrNode);
+	return ret;
+}
+
+static int comparePage(const void* a, const void* b)
+{
+	const struct page* x = *(struct page* const*)a;
+	const struct page* y = *(struct page* const*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+//Stats function: fills the struct mcontainer_stats at arg. Shared pages
+//are found by sorting the pages of every object
+int memory_container_stats(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct mcontainer_stats stats;
+	struct container* ctrNode;
+	struct object** objs;
+	struct page** pages = NULL;
+	unsigned long count, npages = 0, n = 0, unique = 0;
+	unsigned long i, j;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	memset(&stats, 0, sizeof(stats));
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+	objs = getObjectArray(ctrNode, &count);
+	stats.dedup_merged = atomic64_read(&ctrNode->dedup_merged);
+	putContainer(ctrNode);
+	if(objs == NULL)
+	{
+		return -ENOMEM;
+	}
+	for(i = 0; i < count; i++)
+	{
+		npages += READ_ONCE(objs[i]->npages);
+	}
+	pages = allocArray(npages * sizeof(struct page*));
+	for(i = 0; i < count && pages != NULL; i++)
+	{
+		mutex_lock(&objs[i]->page_mutex);
+		stats.compressed += objs[i]->nzpages;
+		stats.compressed_bytes += objs[i]->zbytes;
+		stats.decompressed += objs[i]->decompressed;
+		stats.decompress_ns += objs[i]->decompress_ns;
+		for(j = 0; j < objs[i]->npages && n < npages; j++)
+		{
+			if(objs[i]->pages[j] != NULL)
+			{
+				pages[n++] = objs[i]->pages[j];
+			}
+		}
+		mutex_unlock(&objs[i]->page_mutex);
+	}
+	if(pages != NULL)
+	{
+		sort(pages, n, sizeof(struct page*), comparePage, NULL);
+		for(i = 0; i < n; i++)
+		{
+			if(i == 0 || pages[i] != pages[i - 1])
+			{
+				unique++;
+			}
+		}
+	}
+	for(i = 0; i < count; i++)
+	{
+		putObject(objs[i]);
+	}
+	kvfree(objs);
+	kvfree(pages);
+	if(pages == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	stats.objects = count;
+	stats.bytes = (__u64)n << PAGE_SHIFT;
+	stats.dedup_saved = (__u64)(n - unique) << PAGE_SHIFT;
+	if(copy_to_user((void __user *)ctrCmd.arg, &stats, sizeof(stats)))
+	{
+		return -EFAULT;
+	}
+	return 0;
+}
+
+//Subscribe function: the file receives an event whenever one of the count
+//objects at arg is unlocked or freed; with MCONTAINER_OP_EVENTFD the eventfd
+//in size is signalled too. A new subscription replaces the previous one,
+//count 0 just ends it
+int memory_container_subscribe(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct fileState* state = filp->private_data;
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct subscriber* sub;
+	struct eventfd_ctx* eventfd;
+	unsigned long count;
+	__u64* oids;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	if(state->exported != NULL)
+	{
+		return -EINVAL;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+	if(state->sub != NULL)
+	{
+		putSubscriber(state->sub);
+		state->sub = NULL;
+	}
+	if(ctrCmd.count == 0)
+	{
+		putContainer(ctrNode);
+		return 0;
+	}
+
+	oids = getOidArray(&ctrCmd, &count);
+	if(IS_ERR(oids))
+	{
+		putContainer(ctrNode);
+		return PTR_ERR(oids);
+	}
+	sub = kzalloc(sizeof(struct subscriber), GFP_KERNEL);
+	if(sub == NULL)
+	{
+		kvfree(oids);
+		putContainer(ctrNode);
+		return -ENOMEM;
+	}
+	sub->ctr = ctrNode;		//the subscription takes over the reference
+	sub->oids = oids;
+	sub->count = count;
+	spin_lock_init(&sub->lock);
+	init_waitqueue_head(&sub->wait);
+	if(ctrCmd.op & MCONTAINER_OP_EVENTFD)
+	{
+		eventfd = eventfd_ctx_fdget(ctrCmd.size);
+		if(IS_ERR(eventfd))
+		{
+			kvfree(oids);
+			kfree(sub);
+			putContainer(ctrNode);
+			return PTR_ERR(eventfd);
+		}
+		sub->eventfd = eventfd;
+	}
+
+	mutex_lock(&ctrNode->sub_mutex);
+	sub->next = ctrNode->subs;
+	ctrNode->subs = sub;
+	mutex_unlock(&ctrNode->sub_mutex);
+	state->sub = sub;
+	return 0;
+}
+
+// pinning the pages of a user buffer //
+// only shared mappings: a private page is replaced by the next copy-on-write //
+// (after a fork, for one), and the object would keep the stale one //
+static int importUserPages(struct page** pages, unsigned long addr, unsigned long npages)
+{
+	struct mm_struct* mm = current->mm;
+	struct vm_area_struct* vma;
+	unsigned long end = addr + (npages << PAGE_SHIFT), next = addr;
+	long pinned;
+
+	down_read(&mm->mmap_sem);
+	while(next < end)
+	{
+		vma = find_vma(mm, next);
+		if(vma == NULL || vma->vm_start > next || !(vma->vm_flags & VM_SHARED))
+		{
+			up_read(&mm->mmap_sem);
+			return -EINVAL;
+		}
+		next = vma->vm_end;
+	}
+	up_read(&mm->mmap_sem);
+
+	pinned = get_user_pages_fast(addr, npages, 1, pages);
+
+	if(pinned == npages)
+	{
+		return 0;
+	}
+	while(pinned > 0)
+	{
+		put_page(pages[--pinned]);
+	}
+	return pinned < 0 ? pinned : -EFAULT;
+}
+
+// taking references on the page cache pages of a memfd (tmpfs) file //
+static int importFilePages(struct page** pages, int fd, unsigned long npages)
+{
+	struct file* file = fget(fd);
+	unsigned long i;
+	int ret = 0;
+
+	if(file == NULL)
+	{
+		return -EBADF;
+	}
+	if(file_inode(file)->i_sb->s_magic != TMPFS_MAGIC ||
+	   i_size_read(file_inode(file)) < ((loff_t)npages << PAGE_SHIFT))
+	{
+		fput(file);
+		return -EINVAL;
+	}
+	for(i = 0; i < npages; i++)
+	{
+		pages[i] = shmem_read_mapping_page(file->f_mapping, i);
+		if(IS_ERR(pages[i]))
+		{
+			ret = PTR_ERR(pages[i]);
+			while(i-- > 0)
+			{
+				put_page(pages[i]);
+			}
+			break;
+		}
+	}
+	fput(file);
+	return ret;
+}
+
+//Import function: existing pages become the backing of an empty object
+int memory_container_import(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct object* obj;
+	struct page** pages;
+	unsigned long npages;
+	int ret;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	npages = PAGE_ALIGN(ctrCmd.size) >> PAGE_SHIFT;
+	if(npages == 0 || npages > PAGE_INDEX_MASK + 1)
+	{
+		return -EINVAL;
+	}
+	if(!(ctrCmd.op & MCONTAINER_OP_FD) && (ctrCmd.arg & ~PAGE_MASK))
+	{
+		return -EINVAL;
+	}
+	if(ctrCmd.oid >= MCONTAINER_SLAB_OID)
+	{
+		//the slab and the counter area are not objects of their own
+		return -EINVAL;
+	}
+
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+
+	pages = allocPageArray(npages);
+	if(pages == NULL)
+	{
+		putContainer(ctrNode);
+		return -ENOMEM;
+	}
+	if(ctrCmd.op & MCONTAINER_OP_FD)
+	{
+		ret = importFilePages(pages, (int)ctrCmd.arg, npages);
+	}
+	else
+	{
+		ret = importUserPages(pages, (unsigned long)ctrCmd.arg, npages);
+	}
+	if(ret < 0)
+	{
+		kvfree(pages);
+		putContainer(ctrNode);
+		return ret;
+	}
+
+	mutex_lock(&obj_mutex);
+	obj = getObject(ctrNode, ctrCmd.oid);
+	if(obj == NULL)
+	{
+		obj = getNewObject(ctrCmd.oid, 0);
+		if(obj != NULL)
+		{
+			addObject(ctrNode, obj);
+		}
+	}
+	if(obj != NULL)
+	{
+		kref_get(&obj->ref);
+	}
+	mutex_unlock(&obj_mutex);
+	putContainer(ctrNode);
+	if(obj == NULL)
+	{
+		ret = -ENOMEM;
+		goto out_put;
+	}
+
+	mutex_lock(&obj->page_mutex);
+	if(obj->npages != 0)
+	{
+		ret = -EEXIST;
+	}
+	else
+	{
+		kvfree(obj->pages);
+		obj->pages = pages;
+		obj->npages = npages;
+		obj->flags |= OBJ_IMPORTED;
+		pages = NULL;
+	}
+	mutex_unlock(&obj->page_mutex);
+	putObject(obj);
+
+out_put:
+	if(pages != NULL)
+	{
+		while(npages-- > 0)
+		{
+			put_page(pages[npages]);
+		}
+		kvfree(pages);
+	}
+	return ret;
+}
+
+//Export function: returns a new file descriptor that maps one object
+//from offset 0 and can be handed to tasks outside the container
+int memory_container_export(struct file *filp, struct memory_container_cmd __user *user_cmd)
+{
+	struct memory_container_cmd ctrCmd;
+	struct container* ctrNode;
+	struct object* obj;
+	struct file* file;
+	int fd;
+
+	if(copy_from_user(&ctrCmd, user_cmd, sizeof(struct memory_container_cmd)))
+	{
+		return -EFAULT;
+	}
+	ctrNode = fileContainer(filp);
+	if(ctrNode == NULL)
+	{
+		return -EINVAL;
+	}
+
+	mutex_lock(&obj_mutex);
+	obj = getObject(ctrNode, ctrCmd.oid);
+	if(obj != NULL)
+	{
+		kref_get(&obj->ref);
+	}
+	mutex_unlock(&obj_mutex);
+	putContainer(ctrNode);
+	if(obj == NULL)
+	{
+		return -ENOENT;
+	}
+
+	fd = get_unused_fd_flags(O_CLOEXEC);
+	if(fd < 0)
+	{
+		putObject(obj);
+		return fd;
+	}
+	//a second open of the device, its mappings go on the container's address space too
+	file = dentry_open(&filp->f_path, O_RDWR, current_cred());
+	if(IS_ERR(file))
+	{
+		put_unused_fd(fd);
+		putObject(obj);
+		return PTR_ERR(file);
+	}
+	((struct fileState*)file->private_data)->exported = obj;
+	fd_install(fd, file);
+	return fd;
 }
 
 /**
@@ -554,15 +4219,51 @@ int memory_container_ioctl(struct file *filp, unsigned int cmd,
     switch (cmd)
     {
     case MCONTAINER_IOCTL_CREATE:
-        return memory_container_create((void __user *)arg);
+        return memory_container_create(filp, (void __user *)arg);
     case MCONTAINER_IOCTL_DELETE:
-        return memory_container_delete((void __user *)arg);
+        return memory_container_delete(filp, (void __user *)arg);
     case MCONTAINER_IOCTL_LOCK:
-        return memory_container_lock((void __user *)arg);
+        return memory_container_lock(filp, (void __user *)arg);
     case MCONTAINER_IOCTL_UNLOCK:
-        return memory_container_unlock((void __user *)arg);
+        return memory_container_unlock(filp, (void __user *)arg);
     case MCONTAINER_IOCTL_FREE:
-        return memory_container_free((void __user *)arg);
+        return memory_container_free(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_ALLOC_SMALL:
+        return memory_container_alloc_small(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_PREFETCH:
+        return memory_container_prefetch(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_PREFETCH_WAIT:
+        return memory_container_prefetch_wait(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_RESIZE:
+        return memory_container_resize(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_IMPORT:
+        return memory_container_import(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_EXPORT:
+        return memory_container_export(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_SNAPSHOT:
+        return memory_container_snapshot((void __user *)arg);
+    case MCONTAINER_IOCTL_CHECKPOINT:
+        return memory_container_checkpoint(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_RESTORE:
+        return memory_container_restore(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_LOCK_MANY:
+        return memory_container_lock_many(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_UNLOCK_MANY:
+        return memory_container_unlock_many(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_SUBSCRIBE:
+        return memory_container_subscribe(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_TRACK_DIRTY:
+        return memory_container_track_dirty(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_COLLECT_DIRTY:
+        return memory_container_collect_dirty(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_DEDUP:
+        return memory_container_dedup(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_STATS:
+        return memory_container_stats(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_COMPRESS:
+        return memory_container_compress(filp, (void __user *)arg);
+    case MCONTAINER_IOCTL_MOVE:
+        return memory_container_move(filp, (void __user *)arg);
     default:
         return -ENOTTY;
     }
@@ -30,6 +30,132 @@
 ////////////////////////////////////////////////////////////////////////
 
 #include "mcontainer.h"
+#include "mcontainer_user.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/* sequence counters of the last container read from, mapped on first use */
+static __thread const __u64 *seq_area = NULL;
+static __thread int seq_fd = -1;
+
+static void seq_unmap(void)
+{
+    if (seq_area)
+    {
+        munmap((void *)seq_area, MCONTAINER_SEQ_SIZE);
+        seq_area = NULL;
+        seq_fd = -1;
+    }
+}
+
+/* pages small objects are packed into, mapped once per container */
+static __thread char *slab_area = NULL;
+static __thread int slab_fd = -1;
+
+static size_t slab_window(void)
+{
+    return (size_t)getpagesize() << MCONTAINER_OID_SHIFT;
+}
+
+static void slab_unmap(void)
+{
+    if (slab_area)
+    {
+        munmap(slab_area, slab_window());
+        slab_area = NULL;
+        slab_fd = -1;
+    }
+}
+
+/*
+ * descriptors from mcontainer_open() stay in one container for life, so
+ * their counter and slab mappings are shared by every thread and kept
+ * until mcontainer_close(). The thread-local ones above serve the shared
+ * descriptor of mcontainer_init(), whose container follows the thread.
+ */
+#define MAX_BOUND_FDS 1024
+
+struct bound_areas
+{
+    int bound;
+    void *seq;
+    void *slab;
+};
+
+static struct bound_areas bound_areas[MAX_BOUND_FDS];
+
+static int fd_bound(int devfd)
+{
+    return devfd >= 0 && devfd < MAX_BOUND_FDS && __atomic_load_n(&bound_areas[devfd].bound, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * map object oid of a bound descriptor once; a thread losing the race to
+ * map it drops its own mapping and uses the winner's
+ */
+static void *bound_area(int devfd, void **slot, __u64 oid, size_t size, int prot)
+{
+    void *area = __atomic_load_n(slot, __ATOMIC_ACQUIRE), *none = NULL;
+
+    if (area)
+    {
+        return area;
+    }
+    area = mmap(0, size, prot, MAP_SHARED, devfd, (off_t)(oid << MCONTAINER_OID_SHIFT) * getpagesize());
+    if (area == MAP_FAILED)
+    {
+        return NULL;
+    }
+    if (!__atomic_compare_exchange_n(slot, &none, area, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        munmap(area, size);
+        area = none;
+    }
+    return area;
+}
+
+/**
+ * open the memory container backend and return the descriptor passed to
+ * every other call. MCONTAINER_BACKEND_DEFAULT picks the backend from the
+ * MCONTAINER_BACKEND environment variable ("kernel", "user" or
+ * "user-fast") and falls back to the kernel module.
+ */
+int mcontainer_init(int backend)
+{
+    const char *env = getenv("MCONTAINER_BACKEND");
+
+    if (backend == MCONTAINER_BACKEND_DEFAULT)
+    {
+        backend = MCONTAINER_BACKEND_KERNEL;
+        if (env && !strcmp(env, "user"))
+        {
+            backend = MCONTAINER_BACKEND_USER;
+        }
+        else if (env && !strcmp(env, "user-fast"))
+        {
+            backend = MCONTAINER_BACKEND_USER_FAST;
+        }
+    }
+
+    switch (backend)
+    {
+    case MCONTAINER_BACKEND_USER:
+        return mcontainer_user_open(0);
+    case MCONTAINER_BACKEND_USER_FAST:
+        return mcontainer_user_open(1);
+    default:
+        return open("/dev/mcontainer", O_RDWR);
+    }
+}
 
 /**
  * delete function in user space that sends command to kernel space
@@ -38,6 +164,14 @@
 int mcontainer_delete(int devfd)
 {
     struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_delete(devfd);
+    }
+    seq_unmap();
+    slab_unmap();
+    cmd.op = 0;
     return ioctl(devfd, MCONTAINER_IOCTL_DELETE, &cmd);
 }
 
@@ -48,17 +182,113 @@ int mcontainer_delete(int devfd)
 int mcontainer_create(int devfd, int cid)
 {
     struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_create(devfd, cid);
+    }
+    seq_unmap();
+    slab_unmap();
+    cmd.op = 0;
     cmd.cid = cid;
     return ioctl(devfd, MCONTAINER_IOCTL_CREATE, &cmd);
 }
 
+/**
+ * open a new descriptor bound to container cid, creating the container if
+ * needed. Calls through it act on that container whatever the calling
+ * thread joined with mcontainer_create, so one thread can use several.
+ */
+int mcontainer_open(int backend, int cid)
+{
+    struct memory_container_cmd cmd;
+    int devfd = mcontainer_init(backend);
+
+    if (devfd < 0)
+    {
+        return -1;
+    }
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_bind(cid);
+    }
+    cmd.op = MCONTAINER_OP_BIND;
+    cmd.cid = cid;
+    if (ioctl(devfd, MCONTAINER_IOCTL_CREATE, &cmd) < 0)
+    {
+        close(devfd);
+        return -1;
+    }
+    if (devfd < MAX_BOUND_FDS)
+    {
+        __atomic_store_n(&bound_areas[devfd].bound, 1, __ATOMIC_RELEASE);
+    }
+    return devfd;
+}
+
+/**
+ * close a descriptor of mcontainer_open, leaving its container, or of
+ * mcontainer_init, and drop the mappings the library made through it.
+ */
+int mcontainer_close(int devfd)
+{
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_unbind(devfd);
+    }
+    if (fd_bound(devfd))
+    {
+        if (bound_areas[devfd].seq)
+        {
+            munmap(bound_areas[devfd].seq, MCONTAINER_SEQ_SIZE);
+        }
+        if (bound_areas[devfd].slab)
+        {
+            munmap(bound_areas[devfd].slab, slab_window());
+        }
+        bound_areas[devfd].seq = NULL;
+        bound_areas[devfd].slab = NULL;
+        __atomic_store_n(&bound_areas[devfd].bound, 0, __ATOMIC_RELEASE);
+    }
+    if (devfd == seq_fd)
+    {
+        seq_unmap();
+    }
+    if (devfd == slab_fd)
+    {
+        slab_unmap();
+    }
+    return close(devfd);
+}
+
 /**
  * Allocate memory in kernel space for sharing along with tasks in the same container.
  */
 void *mcontainer_alloc(int devfd, __u64 offset, __u64 size)
 {
     __u64 aligned_size = ((size + getpagesize() - 1) / getpagesize()) * getpagesize();
-    return mmap(0, aligned_size, PROT_READ | PROT_WRITE, MAP_SHARED, devfd, offset * getpagesize());
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_alloc(devfd, offset, size, NULL);
+    }
+    return mmap(0, aligned_size, PROT_READ | PROT_WRITE, MAP_SHARED, devfd, (off_t)(offset << MCONTAINER_OID_SHIFT) * getpagesize());
+}
+
+/**
+ * like mcontainer_alloc, but map the object at the page-aligned addr,
+ * replacing whatever was mapped there. Unmap it with munmap.
+ */
+void *mcontainer_alloc_at(int devfd, __u64 offset, __u64 size, void *addr)
+{
+    __u64 aligned_size = ((size + getpagesize() - 1) / getpagesize()) * getpagesize();
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_alloc(devfd, offset, size, addr);
+    }
+    return mmap(addr, aligned_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, devfd,
+                (off_t)(offset << MCONTAINER_OID_SHIFT) * getpagesize());
 }
 
 /**
@@ -67,26 +297,613 @@ void *mcontainer_alloc(int devfd, __u64 offset, __u64 size)
 int mcontainer_lock(int devfd, __u64 offset)
 {
     struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_lock(devfd, offset, -1);
+    }
+    cmd.op = 0;
     cmd.oid = offset;
     return ioctl(devfd, MCONTAINER_IOCTL_LOCK, &cmd);
 }
 
 /**
- * Unlock a memory page
+ * take the lock of an object only if it is free; fails with EBUSY otherwise
+ */
+int mcontainer_trylock(int devfd, __u64 offset)
+{
+    return mcontainer_lock_timeout(devfd, offset, 0);
+}
+
+/**
+ * take the lock of an object, waiting at most ns nanoseconds; fails with
+ * ETIMEDOUT (or EBUSY when ns is 0) if the object stays locked, and with
+ * EDEADLK if the caller holds it already
+ */
+int mcontainer_lock_timeout(int devfd, __u64 offset, __u64 ns)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_lock(devfd, offset, ns > LLONG_MAX ? -1 : (long long)ns);
+    }
+    cmd.op = MCONTAINER_OP_TIMEOUT;
+    cmd.oid = offset;
+    cmd.arg = ns;
+    return ioctl(devfd, MCONTAINER_IOCTL_LOCK, &cmd);
+}
+
+/**
+ * Unlock a memory page; fails with EPERM unless the caller holds the lock
  */
 int mcontainer_unlock(int devfd, __u64 offset)
 {
     struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_unlock(devfd, offset);
+    }
     cmd.oid = offset;
     return ioctl(devfd, MCONTAINER_IOCTL_UNLOCK, &cmd);
 }
 
+/**
+ * lock n objects in one call. The module takes the locks in ascending oid
+ * order, so callers need not agree on an order, and returns either holding
+ * all of them or none. Duplicate oids are taken once.
+ */
+int mcontainer_lock_many(int devfd, const __u64 *oids, __u64 n)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_lock_many(devfd, oids, n, -1);
+    }
+    cmd.op = 0;
+    cmd.count = n;
+    cmd.arg = (__u64)(unsigned long)oids;
+    return ioctl(devfd, MCONTAINER_IOCTL_LOCK_MANY, &cmd);
+}
+
+/**
+ * lock n objects like mcontainer_lock_many, waiting at most ns nanoseconds
+ * for the whole set; 0 only tries. On ETIMEDOUT (or EBUSY when ns is 0)
+ * none of them is held.
+ */
+int mcontainer_lock_many_timeout(int devfd, const __u64 *oids, __u64 n, __u64 ns)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_lock_many(devfd, oids, n, ns > LLONG_MAX ? -1 : (long long)ns);
+    }
+    cmd.op = MCONTAINER_OP_TIMEOUT;
+    cmd.count = n;
+    cmd.arg = (__u64)(unsigned long)oids;
+    return ioctl(devfd, MCONTAINER_IOCTL_LOCK_MANY, &cmd);
+}
+
+/**
+ * unlock n objects taken with mcontainer_lock_many
+ */
+int mcontainer_unlock_many(int devfd, const __u64 *oids, __u64 n)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_unlock_many(devfd, oids, n);
+    }
+    cmd.count = n;
+    cmd.arg = (__u64)(unsigned long)oids;
+    return ioctl(devfd, MCONTAINER_IOCTL_UNLOCK_MANY, &cmd);
+}
+
 /**
  * removes an object from memory_container
  */
 int mcontainer_free(int devfd, __u64 offset)
 {
     struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_free(devfd, offset);
+    }
     cmd.oid = offset;
     return ioctl(devfd, MCONTAINER_IOCTL_FREE, &cmd);
-}
\ No newline at end of file
+}
+
+/**
+ * release a mapping returned by mcontainer_alloc. Use this rather than
+ * munmap: with the "user-fast" backend the pointer is part of a window
+ * shared by every object and must stay mapped.
+ */
+int mcontainer_unmap(int devfd, void *addr, __u64 size)
+{
+    __u64 aligned_size = ((size + getpagesize() - 1) / getpagesize()) * getpagesize();
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_unmap(addr, aligned_size);
+    }
+    return munmap(addr, aligned_size);
+}
+
+/**
+ * hand the data of an object of the current container over to dst_offset
+ * in container dst_cid without copying. The caller has to be a member of
+ * dst_cid, the target must have no data and the object must not be
+ * locked; mappings of the object fault afterwards.
+ */
+int mcontainer_move(int devfd, __u64 offset, __u64 dst_cid, __u64 dst_offset)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_move(devfd, offset, dst_cid, dst_offset);
+    }
+    cmd.oid = offset;
+    cmd.cid = dst_cid;
+    cmd.arg = dst_offset;
+    return ioctl(devfd, MCONTAINER_IOCTL_MOVE, &cmd);
+}
+
+/**
+ * ask the kernel to allocate and populate objects offset .. offset+count-1
+ * (each of the given size) in the background. Objects that already exist
+ * are left alone. An empty range, or one wrapping around or reaching
+ * MCONTAINER_SLAB_OID, fails with EINVAL.
+ */
+int mcontainer_prefetch(int devfd, __u64 offset, __u64 count, __u64 size)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_prefetch(devfd, offset, count, size);
+    }
+    cmd.oid = offset;
+    cmd.count = count;
+    cmd.size = size;
+    return ioctl(devfd, MCONTAINER_IOCTL_PREFETCH, &cmd);
+}
+
+/**
+ * wait until every prefetch issued in the current container has completed
+ */
+int mcontainer_prefetch_wait(int devfd)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return 0;
+    }
+    return ioctl(devfd, MCONTAINER_IOCTL_PREFETCH_WAIT, &cmd);
+}
+
+/**
+ * grow or shrink an object in place. Growing adds zeroed pages, shrinking
+ * releases the tail pages and unmaps them from every task; no data is copied.
+ */
+int mcontainer_resize(int devfd, __u64 offset, __u64 size)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_resize(devfd, offset, size);
+    }
+    cmd.oid = offset;
+    cmd.size = size;
+    return ioctl(devfd, MCONTAINER_IOCTL_RESIZE, &cmd);
+}
+
+/**
+ * adjust an existing mapping of an object (returned by mcontainer_alloc)
+ * to a new size after mcontainer_resize. Shrinking trims the mapping with
+ * mremap; growing maps the new tail right behind the old window when that
+ * address range is free, otherwise the object is mapped again elsewhere.
+ */
+void *mcontainer_remap(int devfd, __u64 offset, void *addr, __u64 old_size, __u64 new_size)
+{
+    __u64 page = getpagesize();
+    __u64 old_aligned = ((old_size + page - 1) / page) * page;
+    __u64 new_aligned = ((new_size + page - 1) / page) * page;
+    char *tail;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_remap(devfd, offset, addr, old_aligned, new_size);
+    }
+    if (new_aligned <= old_aligned)
+    {
+        return new_aligned == old_aligned ? addr : mremap(addr, old_aligned, new_aligned, 0);
+    }
+
+    tail = mmap((char *)addr + old_aligned, new_aligned - old_aligned, PROT_READ | PROT_WRITE, MAP_SHARED,
+                devfd, (off_t)(offset << MCONTAINER_OID_SHIFT) * page + old_aligned);
+    if (tail == (char *)addr + old_aligned)
+    {
+        return addr;
+    }
+    if (tail != MAP_FAILED)
+    {
+        munmap(tail, new_aligned - old_aligned);
+    }
+    munmap(addr, old_aligned);
+    return mcontainer_alloc(devfd, offset, new_size);
+}
+
+/**
+ * make an existing page-aligned user buffer the backing of a new object
+ * without copying it. The buffer has to be a shared mapping (MAP_SHARED,
+ * a memfd or shared memory): private pages are replaced on copy-on-write,
+ * after a fork for one, so they fail with EINVAL. The pages stay pinned
+ * until the object is freed and writes through either mapping are seen by
+ * the other.
+ */
+int mcontainer_import(int devfd, __u64 offset, const void *ptr, __u64 size)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_import(devfd, offset, ptr, -1, size);
+    }
+    cmd.op = 0;
+    cmd.oid = offset;
+    cmd.size = size;
+    cmd.arg = (__u64)(unsigned long)ptr;
+    return ioctl(devfd, MCONTAINER_IOCTL_IMPORT, &cmd);
+}
+
+/**
+ * same as mcontainer_import, with the first size bytes of a memfd (or any
+ * tmpfs file) as the backing
+ */
+int mcontainer_import_fd(int devfd, __u64 offset, int fd, __u64 size)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_import(devfd, offset, NULL, fd, size);
+    }
+    cmd.op = MCONTAINER_OP_FD;
+    cmd.oid = offset;
+    cmd.size = size;
+    cmd.arg = fd;
+    return ioctl(devfd, MCONTAINER_IOCTL_IMPORT, &cmd);
+}
+
+/**
+ * get a file descriptor bound to one object. It can be passed to another
+ * process (e.g. over a unix socket) that maps it with mmap() at offset 0,
+ * without joining the container.
+ */
+int mcontainer_export(int devfd, __u64 offset)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        errno = ENOTTY;
+        return -1;
+    }
+    cmd.oid = offset;
+    return ioctl(devfd, MCONTAINER_IOCTL_EXPORT, &cmd);
+}
+
+/**
+ * create container dst_cid as a copy-on-write image of container src_cid.
+ * Both containers share pages until one of them writes to a page. Tasks
+ * join the snapshot with mcontainer_create(devfd, dst_cid). Fails with
+ * EPERM unless the caller is a member of src_cid.
+ */
+int mcontainer_snapshot(int devfd, __u64 src_cid, __u64 dst_cid)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_snapshot(devfd, src_cid, dst_cid);
+    }
+    cmd.cid = dst_cid;
+    cmd.arg = src_cid;
+    return ioctl(devfd, MCONTAINER_IOCTL_SNAPSHOT, &cmd);
+}
+
+/**
+ * write every object of the current container to the file fd (opened for
+ * writing). Writers should hold off until it returns. Fails with
+ * EOPNOTSUPP while the container holds objects of mcontainer_alloc_small.
+ */
+int mcontainer_checkpoint(int devfd, int fd)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_checkpoint(devfd, fd);
+    }
+    cmd.arg = fd;
+    return ioctl(devfd, MCONTAINER_IOCTL_CHECKPOINT, &cmd);
+}
+
+/**
+ * recreate the objects of a checkpoint in the current container. The
+ * module only reads the index here; object pages are read from the file
+ * the first time they are touched, and fd may be closed right away.
+ */
+int mcontainer_restore(int devfd, int fd)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_restore(devfd, fd);
+    }
+    cmd.arg = fd;
+    return ioctl(devfd, MCONTAINER_IOCTL_RESTORE, &cmd);
+}
+
+/**
+ * turn dirty-page tracking of the current container on or off. While it is
+ * on, the first write to a page after each collect takes a minor fault.
+ */
+int mcontainer_track_dirty(int devfd, int enable)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return 0;
+    }
+    cmd.op = enable;
+    return ioctl(devfd, MCONTAINER_IOCTL_TRACK_DIRTY, &cmd);
+}
+
+/**
+ * fetch and clear the pages of an object written since the last collect:
+ * bit i of bitmap[i / 64] is page i, for up to npages pages. Returns the
+ * number of pages of the object, which may exceed npages.
+ */
+int mcontainer_collect_dirty(int devfd, __u64 offset, __u64 *bitmap, __u64 npages)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_collect_dirty(devfd, offset, bitmap, npages);
+    }
+    cmd.oid = offset;
+    cmd.count = npages;
+    cmd.arg = (__u64)(unsigned long)bitmap;
+    return ioctl(devfd, MCONTAINER_IOCTL_COLLECT_DIRTY, &cmd);
+}
+
+/**
+ * start or stop background passes that merge identical pages of the current
+ * container into one copy-on-write page. A write to a merged page gets its
+ * own copy back through the same fault as a snapshot.
+ */
+int mcontainer_dedup(int devfd, int enable)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return 0;
+    }
+    cmd.op = enable;
+    return ioctl(devfd, MCONTAINER_IOCTL_DEDUP, &cmd);
+}
+
+/**
+ * fill stats with the objects and backing of the current container and what
+ * dedup saves of it.
+ */
+int mcontainer_stats(int devfd, struct mcontainer_stats *stats)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_stats(devfd, stats);
+    }
+    cmd.arg = (__u64)(unsigned long)stats;
+    return ioctl(devfd, MCONTAINER_IOCTL_STATS, &cmd);
+}
+
+/**
+ * compress objects of the current container that are not mapped and have
+ * not been faulted on or locked for cold_ms; their pages are decompressed
+ * on the next touch. 0 stops compressing more objects. Fails with
+ * EOPNOTSUPP if the kernel has no lz4.
+ */
+int mcontainer_compress(int devfd, __u64 cold_ms)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return 0;
+    }
+    cmd.op = cold_ms;
+    return ioctl(devfd, MCONTAINER_IOCTL_COMPRESS, &cmd);
+}
+
+static const __u64 *seq_slot(int devfd, __u64 offset)
+{
+    const __u64 *base;
+    void *area;
+
+    if (fd_bound(devfd))
+    {
+        base = bound_area(devfd, &bound_areas[devfd].seq, MCONTAINER_SEQ_OID, MCONTAINER_SEQ_SIZE, PROT_READ);
+        return base ? base + (offset % MCONTAINER_SEQ_SLOTS) * (MCONTAINER_SEQ_STRIDE / sizeof(__u64)) : NULL;
+    }
+    if (seq_area && seq_fd != devfd)
+    {
+        seq_unmap();
+    }
+    if (!seq_area)
+    {
+        area = mmap(0, MCONTAINER_SEQ_SIZE, PROT_READ, MAP_SHARED, devfd,
+                    (off_t)(MCONTAINER_SEQ_OID << MCONTAINER_OID_SHIFT) * getpagesize());
+        if (area == MAP_FAILED)
+        {
+            return NULL;
+        }
+        seq_area = area;
+        seq_fd = devfd;
+    }
+    return seq_area + (offset % MCONTAINER_SEQ_SLOTS) * (MCONTAINER_SEQ_STRIDE / sizeof(__u64));
+}
+
+/**
+ * small objects of at most MCONTAINER_SMALL_MAX bytes share pages with
+ * others of the container instead of taking a page each. A new object
+ * starts out zeroed. Returns MAP_FAILED with errno set on failure, like
+ * mcontainer_alloc, on every backend.
+ */
+void *mcontainer_alloc_small(int devfd, __u64 offset, __u64 size)
+{
+    struct memory_container_cmd cmd;
+    char *base;
+    void *area;
+    int ret;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_alloc(devfd, offset, size, NULL);
+    }
+    if (fd_bound(devfd))
+    {
+        base = bound_area(devfd, &bound_areas[devfd].slab, MCONTAINER_SLAB_OID, slab_window(), PROT_READ | PROT_WRITE);
+    }
+    else
+    {
+        if (slab_area && slab_fd != devfd)
+        {
+            slab_unmap();
+        }
+        if (!slab_area)
+        {
+            area = mmap(0, slab_window(), PROT_READ | PROT_WRITE, MAP_SHARED, devfd,
+                        (off_t)(MCONTAINER_SLAB_OID << MCONTAINER_OID_SHIFT) * getpagesize());
+            if (area != MAP_FAILED)
+            {
+                slab_area = area;
+                slab_fd = devfd;
+            }
+        }
+        base = slab_area;
+    }
+    if (!base)
+    {
+        return MAP_FAILED;
+    }
+    cmd.oid = offset;
+    cmd.size = size;
+    ret = ioctl(devfd, MCONTAINER_IOCTL_ALLOC_SMALL, &cmd);
+    if (ret < 0)
+    {
+        return MAP_FAILED;
+    }
+    if (ret == 1)
+    {
+        // a reused chunk still holds the object freed from it
+        memset(base + cmd.arg, 0, size);
+    }
+    return base + cmd.arg;
+}
+
+/**
+ * start an optimistic read of an object without taking its lock: waits
+ * until no writer holds the object (or one sharing its counter) and stores
+ * the counter in *seq. Read the object, then check mcontainer_read_retry;
+ * the read is consistent only if that returns 0.
+ */
+int mcontainer_read_begin(int devfd, __u64 offset, __u64 *seq)
+{
+    const __u64 *slot;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_read_begin(devfd, offset, seq);
+    }
+    slot = seq_slot(devfd, offset);
+    if (!slot)
+    {
+        return -1;
+    }
+    while ((*seq = __atomic_load_n(slot, __ATOMIC_ACQUIRE)) & MCONTAINER_SEQ_WRITERS)
+    {
+        cpu_relax();
+    }
+    return 0;
+}
+
+/**
+ * nonzero if a writer may have changed the object since mcontainer_read_begin
+ * returned seq, so what was read has to be thrown away and read again
+ */
+int mcontainer_read_retry(int devfd, __u64 offset, __u64 seq)
+{
+    const __u64 *slot;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        return mcontainer_user_read_retry(devfd, offset, seq);
+    }
+    slot = seq_slot(devfd, offset);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return !slot || __atomic_load_n(slot, __ATOMIC_RELAXED) != seq;
+}
+
+/**
+ * get an event on devfd whenever one of n objects is unlocked or freed.
+ * devfd becomes readable for poll()/epoll; if eventfd is not -1 it is
+ * signalled as well. A new call replaces the previous set, n == 0 ends it.
+ * Not available with the user-space backend (ENOTTY).
+ */
+int mcontainer_subscribe(int devfd, const __u64 *oids, __u64 n, int eventfd)
+{
+    struct memory_container_cmd cmd;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        errno = ENOTTY;
+        return -1;
+    }
+    cmd.op = eventfd >= 0 ? MCONTAINER_OP_EVENTFD : 0;
+    cmd.size = eventfd;
+    cmd.count = n;
+    cmd.arg = (__u64)(unsigned long)oids;
+    return ioctl(devfd, MCONTAINER_IOCTL_SUBSCRIBE, &cmd);
+}
+
+/**
+ * fetch up to max pending events; blocks until there is one unless devfd
+ * is non-blocking. Returns the number of events.
+ */
+int mcontainer_read_events(int devfd, struct mcontainer_event *events, int max)
+{
+    ssize_t n;
+
+    if (mcontainer_user_owns(devfd))
+    {
+        errno = ENOTTY;
+        return -1;
+    }
+    n = read(devfd, events, max * sizeof(*events));
+    return n < 0 ? -1 : (int)(n / sizeof(*events));
+}
@@ -42,12 +42,58 @@ extern "C"
 #include <stdio.h>
 #include <stdlib.h>
 
+#define MCONTAINER_BACKEND_DEFAULT   0
+#define MCONTAINER_BACKEND_KERNEL    1
+#define MCONTAINER_BACKEND_USER      2
+#define MCONTAINER_BACKEND_USER_FAST 3
+
+#define MCONTAINER_QUEUE_SPSC 0
+#define MCONTAINER_QUEUE_MPMC 1
+
+    struct mcontainer_queue;
+
+    int mcontainer_init(int backend);
     int mcontainer_delete(int devfd);
     int mcontainer_create(int devfd, int cid);
+    int mcontainer_open(int backend, int cid);
+    int mcontainer_close(int devfd);
     void *mcontainer_alloc(int devfd, __u64 offset, __u64 size);
+    void *mcontainer_alloc_at(int devfd, __u64 offset, __u64 size, void *addr);
+    void *mcontainer_alloc_small(int devfd, __u64 offset, __u64 size);
+    int mcontainer_unmap(int devfd, void *addr, __u64 size);
     int mcontainer_lock(int devfd, __u64 offset);
+    int mcontainer_trylock(int devfd, __u64 offset);
+    int mcontainer_lock_timeout(int devfd, __u64 offset, __u64 ns);
     int mcontainer_unlock(int devfd, __u64 offset);
+    int mcontainer_lock_many(int devfd, const __u64 *oids, __u64 n);
+    int mcontainer_lock_many_timeout(int devfd, const __u64 *oids, __u64 n, __u64 ns);
+    int mcontainer_unlock_many(int devfd, const __u64 *oids, __u64 n);
+    int mcontainer_read_begin(int devfd, __u64 offset, __u64 *seq);
+    int mcontainer_read_retry(int devfd, __u64 offset, __u64 seq);
+    int mcontainer_subscribe(int devfd, const __u64 *oids, __u64 n, int eventfd);
+    int mcontainer_read_events(int devfd, struct mcontainer_event *events, int max);
     int mcontainer_free(int devfd, __u64 offset);
+    int mcontainer_move(int devfd, __u64 offset, __u64 dst_cid, __u64 dst_offset);
+    int mcontainer_prefetch(int devfd, __u64 offset, __u64 count, __u64 size);
+    int mcontainer_prefetch_wait(int devfd);
+    int mcontainer_resize(int devfd, __u64 offset, __u64 size);
+    void *mcontainer_remap(int devfd, __u64 offset, void *addr, __u64 old_size, __u64 new_size);
+    int mcontainer_import(int devfd, __u64 offset, const void *ptr, __u64 size);
+    int mcontainer_import_fd(int devfd, __u64 offset, int fd, __u64 size);
+    int mcontainer_export(int devfd, __u64 offset);
+    int mcontainer_snapshot(int devfd, __u64 src_cid, __u64 dst_cid);
+    int mcontainer_checkpoint(int devfd, int fd);
+    int mcontainer_restore(int devfd, int fd);
+    int mcontainer_track_dirty(int devfd, int enable);
+    int mcontainer_collect_dirty(int devfd, __u64 offset, __u64 *bitmap, __u64 npages);
+    int mcontainer_dedup(int devfd, int enable);
+    int mcontainer_stats(int devfd, struct mcontainer_stats *stats);
+    int mcontainer_compress(int devfd, __u64 cold_ms);
+
+    struct mcontainer_queue *mcontainer_queue_open(int devfd, __u64 offset, __u32 capacity, __u32 msg_size, int flags);
+    int mcontainer_queue_close(int devfd, struct mcontainer_queue *queue);
+    int mcontainer_queue_push(struct mcontainer_queue *queue, const void *msg);
+    int mcontainer_queue_pop(struct mcontainer_queue *queue, void *msg);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,415 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Description:
+//     Header-Only C++ Interface of Memory Container in User Space
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef MCONTAINER_HPP
+#define MCONTAINER_HPP
+
+#include <mcontainer.h>
+#include <cerrno>
+#include <cstddef>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Page size objects are rounded up to. It has to match the kernel's for
+ * Object<T>::mapped_size to be right; override it before including this
+ * header on machines with larger pages.
+ */
+#ifndef MCONTAINER_PAGE_SIZE
+#define MCONTAINER_PAGE_SIZE 4096
+#endif
+
+namespace mcontainer
+{
+
+/**
+ * Failures of the C calls are thrown as std::system_error carrying errno.
+ */
+[[noreturn]] inline void throw_errno(const char *what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+constexpr std::size_t page_align(std::size_t size)
+{
+    return (size + MCONTAINER_PAGE_SIZE - 1) / MCONTAINER_PAGE_SIZE * MCONTAINER_PAGE_SIZE;
+}
+
+/**
+ * The descriptor of mcontainer_init(); the calling thread joins and leaves
+ * containers through it with create() and remove().
+ */
+class Device
+{
+  public:
+    explicit Device(int backend = MCONTAINER_BACKEND_DEFAULT) : fd_(mcontainer_init(backend))
+    {
+        if (fd_ < 0)
+        {
+            throw_errno("mcontainer_init");
+        }
+    }
+    Device(Device &&other) noexcept : fd_(other.fd_)
+    {
+        other.fd_ = -1;
+    }
+    Device &operator=(Device &&other) noexcept
+    {
+        std::swap(fd_, other.fd_);
+        return *this;
+    }
+    Device(const Device &) = delete;
+    Device &operator=(const Device &) = delete;
+    ~Device()
+    {
+        // the shared fd of the user backends is not closed by this
+        if (fd_ >= 0)
+        {
+            mcontainer_close(fd_);
+        }
+    }
+
+    void create(int cid)
+    {
+        if (mcontainer_create(fd_, cid) < 0)
+        {
+            throw_errno("mcontainer_create");
+        }
+    }
+    void remove()
+    {
+        if (mcontainer_delete(fd_) < 0)
+        {
+            throw_errno("mcontainer_delete");
+        }
+    }
+    int fd() const noexcept
+    {
+        return fd_;
+    }
+
+  private:
+    int fd_;
+};
+
+/**
+ * A descriptor of mcontainer_open() bound to one container, any number of
+ * which can be open in a thread. Closing it leaves the container.
+ */
+class Container
+{
+  public:
+    explicit Container(int cid, int backend = MCONTAINER_BACKEND_DEFAULT) : fd_(mcontainer_open(backend, cid))
+    {
+        if (fd_ < 0)
+        {
+            throw_errno("mcontainer_open");
+        }
+    }
+    Container(Container &&other) noexcept : fd_(other.fd_)
+    {
+        other.fd_ = -1;
+    }
+    Container &operator=(Container &&other) noexcept
+    {
+        std::swap(fd_, other.fd_);
+        return *this;
+    }
+    Container(const Container &) = delete;
+    Container &operator=(const Container &) = delete;
+    ~Container()
+    {
+        if (fd_ >= 0)
+        {
+            mcontainer_close(fd_);
+        }
+    }
+
+    void free(__u64 oid)
+    {
+        if (mcontainer_free(fd_, oid) < 0)
+        {
+            throw_errno("mcontainer_free");
+        }
+    }
+    int fd() const noexcept
+    {
+        return fd_;
+    }
+
+  private:
+    int fd_;
+};
+
+/**
+ * The kernel lock of one object, meeting Lockable so it works with
+ * std::lock_guard, std::unique_lock and std::lock. unlock() cannot fail
+ * for a lock held by the caller and reports nothing.
+ */
+class Lock
+{
+  public:
+    Lock(int devfd, __u64 oid) noexcept : fd_(devfd), oid_(oid)
+    {
+    }
+
+    void lock()
+    {
+        if (mcontainer_lock(fd_, oid_) < 0)
+        {
+            throw_errno("mcontainer_lock");
+        }
+    }
+    bool try_lock()
+    {
+        if (mcontainer_trylock(fd_, oid_) == 0)
+        {
+            return true;
+        }
+        if (errno != EBUSY)
+        {
+            throw_errno("mcontainer_trylock");
+        }
+        return false;
+    }
+    void unlock() noexcept
+    {
+        mcontainer_unlock(fd_, oid_);
+    }
+
+  private:
+    int fd_;
+    __u64 oid_;
+};
+
+/**
+ * Shared state of every object view: the mapping, made once by the
+ * constructor and released by the destructor, and the object lock.
+ */
+class ObjectBase
+{
+  public:
+    ObjectBase(ObjectBase &&other) noexcept : fd_(other.fd_), oid_(other.oid_), addr_(other.addr_), size_(other.size_)
+    {
+        other.addr_ = nullptr;
+    }
+    ObjectBase &operator=(ObjectBase &&other) noexcept
+    {
+        std::swap(fd_, other.fd_);
+        std::swap(oid_, other.oid_);
+        std::swap(addr_, other.addr_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+    ObjectBase(const ObjectBase &) = delete;
+    ObjectBase &operator=(const ObjectBase &) = delete;
+    ~ObjectBase()
+    {
+        if (addr_)
+        {
+            mcontainer_unmap(fd_, addr_, size_);
+        }
+    }
+
+    __u64 oid() const noexcept
+    {
+        return oid_;
+    }
+    Lock mutex() const noexcept
+    {
+        return Lock(fd_, oid_);
+    }
+    void lock()
+    {
+        mutex().lock();
+    }
+    bool try_lock()
+    {
+        return mutex().try_lock();
+    }
+    void unlock() noexcept
+    {
+        mutex().unlock();
+    }
+
+  protected:
+    ObjectBase(int devfd, __u64 oid, std::size_t size) : fd_(devfd), oid_(oid), size_(size)
+    {
+        addr_ = mcontainer_alloc(devfd, oid, size);
+        if (addr_ == MAP_FAILED)
+        {
+            throw_errno("mcontainer_alloc");
+        }
+    }
+
+    int fd_;
+    __u64 oid_;
+    void *addr_;
+    std::size_t size_;
+};
+
+/**
+ * A move-only typed view of object oid holding one T. The object is sized
+ * for T, so the mapped size is known at compile time; T lives in shared
+ * memory and has to be trivially copyable.
+ */
+template <typename T>
+class Object : public ObjectBase
+{
+    static_assert(std::is_trivially_copyable<T>::value, "container objects hold trivially copyable types");
+
+  public:
+    static constexpr std::size_t mapped_size = page_align(sizeof(T));
+
+    Object(int devfd, __u64 oid) : ObjectBase(devfd, oid, sizeof(T))
+    {
+    }
+    Object(const Container &ctr, __u64 oid) : Object(ctr.fd(), oid)
+    {
+    }
+    Object(const Device &dev, __u64 oid) : Object(dev.fd(), oid)
+    {
+    }
+
+    static constexpr std::size_t size() noexcept
+    {
+        return sizeof(T);
+    }
+    T *get() const noexcept
+    {
+        return static_cast<T *>(addr_);
+    }
+    T &operator*() const noexcept
+    {
+        return *get();
+    }
+    T *operator->() const noexcept
+    {
+        return get();
+    }
+};
+
+template <typename T>
+constexpr std::size_t Object<T>::mapped_size;
+
+/**
+ * A view of an object holding an array of T whose length is only known at
+ * run time.
+ */
+template <typename T>
+class Object<T[]> : public ObjectBase
+{
+    static_assert(std::is_trivially_copyable<T>::value, "container objects hold trivially copyable types");
+
+  public:
+    Object(int devfd, __u64 oid, std::size_t count) : ObjectBase(devfd, oid, count * sizeof(T)), count_(count)
+    {
+    }
+    Object(const Container &ctr, __u64 oid, std::size_t count) : Object(ctr.fd(), oid, count)
+    {
+    }
+    Object(const Device &dev, __u64 oid, std::size_t count) : Object(dev.fd(), oid, count)
+    {
+    }
+
+    std::size_t size() const noexcept
+    {
+        return count_;
+    }
+    std::size_t mapped_size() const noexcept
+    {
+        return page_align(count_ * sizeof(T));
+    }
+    T *get() const noexcept
+    {
+        return static_cast<T *>(addr_);
+    }
+    T &operator[](std::size_t i) const noexcept
+    {
+        return get()[i];
+    }
+    T *begin() const noexcept
+    {
+        return get();
+    }
+    T *end() const noexcept
+    {
+        return get() + count_;
+    }
+
+  private:
+    std::size_t count_;
+};
+
+/**
+ * A view of a fixed-size array object, sized at compile time like Object<T>.
+ */
+template <typename T, std::size_t N>
+class Object<T[N]> : public ObjectBase
+{
+    static_assert(std::is_trivially_copyable<T>::value, "container objects hold trivially copyable types");
+
+  public:
+    static constexpr std::size_t mapped_size = page_align(N * sizeof(T));
+
+    Object(int devfd, __u64 oid) : ObjectBase(devfd, oid, N * sizeof(T))
+    {
+    }
+    Object(const Container &ctr, __u64 oid) : Object(ctr.fd(), oid)
+    {
+    }
+    Object(const Device &dev, __u64 oid) : Object(dev.fd(), oid)
+    {
+    }
+
+    static constexpr std::size_t size() noexcept
+    {
+        return N;
+    }
+    T *get() const noexcept
+    {
+        return static_cast<T *>(addr_);
+    }
+    T &operator[](std::size_t i) const noexcept
+    {
+        return get()[i];
+    }
+    T *begin() const noexcept
+    {
+        return get();
+    }
+    T *end() const noexcept
+    {
+        return get() + N;
+    }
+};
+
+template <typename T, std::size_t N>
+constexpr std::size_t Object<T[N]>::mapped_size;
+
+} // namespace mcontainer
+
+#endif
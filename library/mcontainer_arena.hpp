@@ -0,0 +1,522 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Description:
+//     Shared Arena Allocator over Memory Container Objects (C++17)
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef MCONTAINER_ARENA_HPP
+#define MCONTAINER_ARENA_HPP
+
+#include <mcontainer.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+namespace mcontainer
+{
+
+/**
+ * A pointer stored as the distance from itself to its target, so it stays
+ * valid in every task however the memory holding both is mapped. Both have
+ * to lie in the same arena. It meets the allocator pointer requirements,
+ * which lets standard containers built with Allocator<T> live in an arena.
+ */
+template <typename T>
+class offset_ptr
+{
+  public:
+    using element_type = T;
+    using value_type = std::remove_cv_t<T>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T *;
+    using reference = std::add_lvalue_reference_t<T>;
+    using iterator_category = std::random_access_iterator_tag;
+
+    offset_ptr() noexcept : off_(null)
+    {
+    }
+    offset_ptr(std::nullptr_t) noexcept : off_(null)
+    {
+    }
+    offset_ptr(T *p) noexcept
+    {
+        set(p);
+    }
+    offset_ptr(const offset_ptr &other) noexcept
+    {
+        set(other.get());
+    }
+    template <typename U, typename = std::enable_if_t<std::is_convertible<U *, T *>::value>>
+    offset_ptr(const offset_ptr<U> &other) noexcept
+    {
+        set(other.get());
+    }
+    // what static_cast<T *> of a void * does
+    template <typename U, typename = std::enable_if_t<std::is_void<U>::value && !std::is_void<T>::value>, typename = void>
+    explicit offset_ptr(const offset_ptr<U> &other) noexcept
+    {
+        set(static_cast<T *>(other.get()));
+    }
+    offset_ptr &operator=(const offset_ptr &other) noexcept
+    {
+        set(other.get());
+        return *this;
+    }
+
+    template <typename U = T>
+    static offset_ptr pointer_to(U &r) noexcept
+    {
+        return offset_ptr(std::addressof(r));
+    }
+
+    T *get() const noexcept
+    {
+        return off_ == null ? nullptr : reinterpret_cast<T *>(const_cast<char *>(reinterpret_cast<const char *>(this)) + off_);
+    }
+    reference operator*() const noexcept
+    {
+        return *get();
+    }
+    T *operator->() const noexcept
+    {
+        return get();
+    }
+    template <typename U = T>
+    U &operator[](difference_type i) const noexcept
+    {
+        return get()[i];
+    }
+    explicit operator bool() const noexcept
+    {
+        return off_ != null;
+    }
+
+    offset_ptr &operator+=(difference_type n) noexcept
+    {
+        set(get() + n);
+        return *this;
+    }
+    offset_ptr &operator-=(difference_type n) noexcept
+    {
+        set(get() - n);
+        return *this;
+    }
+    offset_ptr &operator++() noexcept
+    {
+        return *this += 1;
+    }
+    offset_ptr &operator--() noexcept
+    {
+        return *this -= 1;
+    }
+    offset_ptr operator++(int) noexcept
+    {
+        offset_ptr old(*this);
+        ++*this;
+        return old;
+    }
+    offset_ptr operator--(int) noexcept
+    {
+        offset_ptr old(*this);
+        --*this;
+        return old;
+    }
+    friend offset_ptr operator+(offset_ptr p, difference_type n) noexcept
+    {
+        return p += n;
+    }
+    friend offset_ptr operator+(difference_type n, offset_ptr p) noexcept
+    {
+        return p += n;
+    }
+    friend offset_ptr operator-(offset_ptr p, difference_type n) noexcept
+    {
+        return p -= n;
+    }
+    friend difference_type operator-(const offset_ptr &a, const offset_ptr &b) noexcept
+    {
+        return a.get() - b.get();
+    }
+
+    friend bool operator==(const offset_ptr &a, const offset_ptr &b) noexcept
+    {
+        return a.get() == b.get();
+    }
+    friend bool operator!=(const offset_ptr &a, const offset_ptr &b) noexcept
+    {
+        return a.get() != b.get();
+    }
+    friend bool operator<(const offset_ptr &a, const offset_ptr &b) noexcept
+    {
+        return a.get() < b.get();
+    }
+    friend bool operator>(const offset_ptr &a, const offset_ptr &b) noexcept
+    {
+        return a.get() > b.get();
+    }
+    friend bool operator<=(const offset_ptr &a, const offset_ptr &b) noexcept
+    {
+        return a.get() <= b.get();
+    }
+    friend bool operator>=(const offset_ptr &a, const offset_ptr &b) noexcept
+    {
+        return a.get() >= b.get();
+    }
+
+  private:
+    // an offset of 1 can never point at a T, it stands for nullptr
+    static constexpr difference_type null = 1;
+
+    void set(T *p) noexcept
+    {
+        off_ = p ? reinterpret_cast<const char *>(p) - reinterpret_cast<const char *>(this) : null;
+    }
+
+    difference_type off_;
+};
+
+/**
+ * The allocator state at the start of an arena, shared by every task that
+ * maps it. Blocks come in power-of-two classes from 16 bytes; a class is
+ * refilled from the untouched end of the arena and freed blocks are kept
+ * on a list per class, linked through their first 8 bytes. A spin lock
+ * held for a few instructions guards it all.
+ */
+class Heap
+{
+  public:
+    static constexpr std::size_t max_align = MCONTAINER_PAGE_SIZE;
+
+    void *allocate(std::size_t bytes, std::size_t alignment)
+    {
+        int c = size_class(bytes, alignment);
+        std::uint64_t block = 0, size;
+
+        if (c < 0)
+        {
+            throw std::bad_alloc();
+        }
+        size = std::uint64_t(1) << c;
+        acquire();
+        if (free_[c])
+        {
+            block = free_[c];
+            free_[c] = *static_cast<std::uint64_t *>(at(block));
+        }
+        else
+        {
+            block = (top_ + block_align(c) - 1) & ~(block_align(c) - 1);
+            if (block + size > capacity_ || block + size < block)
+            {
+                block = 0;
+            }
+            else
+            {
+                top_ = block + size;
+            }
+        }
+        release();
+        if (!block)
+        {
+            throw std::bad_alloc();
+        }
+        return at(block);
+    }
+
+    void deallocate(void *p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        int c = size_class(bytes, alignment);
+        std::uint64_t block = static_cast<char *>(p) - reinterpret_cast<char *>(this);
+
+        acquire();
+        *static_cast<std::uint64_t *>(p) = free_[c];
+        free_[c] = block;
+        release();
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return capacity_;
+    }
+    // bytes taken from the end of the arena so far, freed blocks included
+    std::size_t used() const noexcept
+    {
+        return top_;
+    }
+
+    // where tasks find what was built in the arena
+    offset_ptr<void> root;
+
+  private:
+    friend class Arena;
+
+    static constexpr int classes = 48;
+    static constexpr std::uint32_t ready = 2;
+
+    static int size_class(std::size_t bytes, std::size_t alignment) noexcept
+    {
+        std::size_t need = bytes > alignment ? bytes : alignment;
+        int c = 4;
+
+        if (alignment > max_align)
+        {
+            return -1;
+        }
+        while (c < classes && (std::size_t(1) << c) < need)
+        {
+            c++;
+        }
+        return c < classes ? c : -1;
+    }
+    // blocks of a class are aligned to its size, up to a page
+    static std::uint64_t block_align(int c) noexcept
+    {
+        return c < 12 ? std::uint64_t(1) << c : max_align;
+    }
+
+    void *at(std::uint64_t offset) noexcept
+    {
+        return reinterpret_cast<char *>(this) + offset;
+    }
+    void acquire() noexcept
+    {
+        while (lock_.exchange(1, std::memory_order_acquire))
+        {
+            while (lock_.load(std::memory_order_relaxed))
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+    void release() noexcept
+    {
+        lock_.store(0, std::memory_order_release);
+    }
+
+    // objects start zeroed: 0 is a fresh arena, 1 one being set up, both
+    // (re)initialized under the object lock of the first object
+    std::atomic<std::uint32_t> state_;
+    std::atomic<std::uint32_t> lock_;
+    std::uint64_t capacity_;
+    std::uint64_t top_;
+    std::uint64_t free_[classes];
+
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "the arena lock has to work across processes");
+};
+
+/**
+ * An arena spanning objects first_oid .. first_oid + count - 1, each of
+ * object_size bytes. They are mapped back to back, so the arena is one
+ * contiguous range in every task and offset pointers reach across objects.
+ * The first task to map an arena sets it up under the object lock of
+ * first_oid; the others find it ready.
+ *
+ * As a std::pmr::memory_resource it serves std::pmr containers, which
+ * keep plain pointers and so are only usable by the task that built them.
+ * Structures shared between tasks use Allocator<T>, whose pointers are
+ * offset_ptrs, and are found through root().
+ */
+class Arena : public std::pmr::memory_resource
+{
+  public:
+    Arena(int devfd, __u64 first_oid, std::size_t count, std::size_t object_size)
+        : size_(page_align(object_size) * count)
+    {
+        std::size_t i;
+        char *base;
+
+        if (count == 0 || size_ < sizeof(Heap))
+        {
+            throw std::invalid_argument("mcontainer::Arena: too small for its header");
+        }
+        // reserve the whole range first, then map each object into it
+        base = static_cast<char *>(mmap(0, size_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+        if (base == MAP_FAILED)
+        {
+            throw_errno("mmap");
+        }
+        for (i = 0; i < count; i++)
+        {
+            if (mcontainer_alloc_at(devfd, first_oid + i, page_align(object_size), base + i * page_align(object_size)) == MAP_FAILED)
+            {
+                int err = errno;
+                munmap(base, size_);
+                errno = err;
+                throw_errno("mcontainer_alloc_at");
+            }
+        }
+        heap_ = reinterpret_cast<Heap *>(base);
+
+        // the first mapper sets the heap up under the object lock of
+        // first_oid; one that dies halfway leaves the state at 1, and the
+        // lock to the next mapper, which starts over
+        if (heap_->state_.load(std::memory_order_acquire) != Heap::ready)
+        {
+            if (mcontainer_lock(devfd, first_oid) < 0)
+            {
+                int err = errno;
+                munmap(base, size_);
+                errno = err;
+                throw_errno("mcontainer_lock");
+            }
+            if (heap_->state_.load(std::memory_order_acquire) != Heap::ready)
+            {
+                heap_->state_.store(1, std::memory_order_relaxed);
+                heap_->lock_.store(0, std::memory_order_relaxed);
+                heap_->capacity_ = size_;
+                heap_->top_ = sizeof(Heap);
+                std::fill(std::begin(heap_->free_), std::end(heap_->free_), 0);
+                heap_->root = nullptr;
+                heap_->state_.store(Heap::ready, std::memory_order_release);
+            }
+            mcontainer_unlock(devfd, first_oid);
+        }
+        if (heap_->capacity_ != size_)
+        {
+            munmap(base, size_);
+            throw std::invalid_argument("mcontainer::Arena: mapped with a different size before");
+        }
+    }
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena() override
+    {
+        munmap(heap_, size_);
+    }
+
+    Heap &heap() const noexcept
+    {
+        return *heap_;
+    }
+    offset_ptr<void> &root() const noexcept
+    {
+        return heap_->root;
+    }
+    void *base() const noexcept
+    {
+        return heap_;
+    }
+    std::size_t capacity() const noexcept
+    {
+        return size_;
+    }
+
+  protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return heap_->allocate(bytes, alignment);
+    }
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+    {
+        heap_->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+  private:
+    std::size_t size_;
+    Heap *heap_;
+};
+
+/**
+ * A standard allocator over an arena that reaches it through an offset
+ * pointer, so a container holding one can be placed in the arena and
+ * grown by any task mapping it.
+ */
+template <typename T>
+class Allocator
+{
+  public:
+    using value_type = T;
+    using pointer = offset_ptr<T>;
+    using const_pointer = offset_ptr<const T>;
+    using void_pointer = offset_ptr<void>;
+    using const_void_pointer = offset_ptr<const void>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = Allocator<U>;
+    };
+
+    explicit Allocator(const Arena &arena) noexcept : heap_(&arena.heap())
+    {
+    }
+    explicit Allocator(Heap &heap) noexcept : heap_(&heap)
+    {
+    }
+    Allocator(const Allocator &other) noexcept : heap_(other.heap_)
+    {
+    }
+    template <typename U>
+    Allocator(const Allocator<U> &other) noexcept : heap_(&other.heap())
+    {
+    }
+    Allocator &operator=(const Allocator &other) noexcept
+    {
+        heap_ = other.heap_;
+        return *this;
+    }
+
+    pointer allocate(std::size_t n)
+    {
+        return pointer(static_cast<T *>(heap_->allocate(n * sizeof(T), alignof(T))));
+    }
+    void deallocate(pointer p, std::size_t n) noexcept
+    {
+        heap_->deallocate(p.get(), n * sizeof(T), alignof(T));
+    }
+    Heap &heap() const noexcept
+    {
+        return *heap_;
+    }
+
+    template <typename U>
+    friend bool operator==(const Allocator &a, const Allocator<U> &b) noexcept
+    {
+        return &a.heap() == &b.heap();
+    }
+    template <typename U>
+    friend bool operator!=(const Allocator &a, const Allocator<U> &b) noexcept
+    {
+        return &a.heap() != &b.heap();
+    }
+
+  private:
+    offset_ptr<Heap> heap_;
+};
+
+} // namespace mcontainer
+
+#endif
@@ -0,0 +1,299 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Description:
+//     Lock-Free Ring Queues in Memory Container Objects
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "mcontainer.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUEUE_MAGIC 0x6d637175 // "mcqu"
+#define CACHE_LINE  64
+
+enum
+{
+    QUEUE_EMPTY = 0, // the object is still zeroed
+    QUEUE_READY,
+};
+
+/**
+ * Layout of a queue object. The producer and consumer indices sit on cache
+ * lines of their own so the two sides do not invalidate each other's line
+ * on every message. Indices only grow; slot i holds message i % capacity.
+ * MPMC slots start with a sequence number (Vyukov's bounded queue): it is
+ * i while slot i is free for message i, and i + 1 once message i is in.
+ */
+struct queue_shared
+{
+    __u32 state;
+    __u32 magic;
+    __u32 flags;
+    __u32 capacity; // power of two
+    __u32 msg_size;
+    __u32 slot_size;
+    char pad0[CACHE_LINE - 6 * sizeof(__u32)];
+    __u64 head; // next message to push
+    char pad1[CACHE_LINE - sizeof(__u64)];
+    __u64 tail; // next message to pop
+    char pad2[CACHE_LINE - sizeof(__u64)];
+    char slots[];
+};
+
+/**
+ * The per-task handle. SPSC sides remember the last index seen of the
+ * other side and only reread the shared one when that looks full or empty.
+ */
+struct mcontainer_queue
+{
+    struct queue_shared *q;
+    __u64 size;
+    __u64 cached_head;
+    __u64 cached_tail;
+};
+
+static __u64 queue_size(__u32 capacity, __u32 slot_size)
+{
+    return sizeof(struct queue_shared) + (__u64)capacity * slot_size;
+}
+
+static char *slot(struct queue_shared *q, __u64 index)
+{
+    return q->slots + (index & (q->capacity - 1)) * q->slot_size;
+}
+
+/**
+ * Map the queue in object offset of the current container, creating it
+ * with room for capacity (rounded up to a power of two) messages of
+ * msg_size bytes if it is new. flags is MCONTAINER_QUEUE_SPSC or
+ * MCONTAINER_QUEUE_MPMC; every opener has to pass the same arguments.
+ * A new queue is set up under the object lock of offset.
+ */
+struct mcontainer_queue *mcontainer_queue_open(int devfd, __u64 offset, __u32 capacity, __u32 msg_size, int flags)
+{
+    struct mcontainer_queue *handle;
+    struct queue_shared *q;
+    __u32 slot_size, i;
+
+    if (capacity == 0 || capacity > (1U << 31) || msg_size == 0 ||
+        (flags != MCONTAINER_QUEUE_SPSC && flags != MCONTAINER_QUEUE_MPMC))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    while (capacity & (capacity - 1))
+    {
+        capacity += capacity & -capacity;
+    }
+    slot_size = (msg_size + (flags == MCONTAINER_QUEUE_MPMC ? sizeof(__u64) : 0) + 7) & ~7U;
+
+    handle = calloc(1, sizeof(*handle));
+    if (!handle)
+    {
+        return NULL;
+    }
+    handle->size = queue_size(capacity, slot_size);
+    q = mcontainer_alloc(devfd, offset, handle->size);
+    if (q == MAP_FAILED)
+    {
+        free(handle);
+        return NULL;
+    }
+
+    // the first opener initializes the queue under the object lock; an
+    // opener that dies halfway leaves it EMPTY, and the lock to the next
+    if (__atomic_load_n(&q->state, __ATOMIC_ACQUIRE) != QUEUE_READY)
+    {
+        if (mcontainer_lock(devfd, offset) < 0)
+        {
+            mcontainer_unmap(devfd, q, handle->size);
+            free(handle);
+            return NULL;
+        }
+        if (__atomic_load_n(&q->state, __ATOMIC_ACQUIRE) != QUEUE_READY)
+        {
+            q->magic = QUEUE_MAGIC;
+            q->flags = flags;
+            q->capacity = capacity;
+            q->msg_size = msg_size;
+            q->slot_size = slot_size;
+            q->head = q->tail = 0;
+            for (i = 0; flags == MCONTAINER_QUEUE_MPMC && i < capacity; i++)
+            {
+                *(__u64 *)slot(q, i) = i;
+            }
+            __atomic_store_n(&q->state, QUEUE_READY, __ATOMIC_RELEASE);
+        }
+        mcontainer_unlock(devfd, offset);
+    }
+    if (q->magic != QUEUE_MAGIC || q->flags != (__u32)flags || q->capacity != capacity || q->msg_size != msg_size)
+    {
+        mcontainer_unmap(devfd, q, handle->size);
+        free(handle);
+        errno = EINVAL;
+        return NULL;
+    }
+    handle->q = q;
+    handle->cached_head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    handle->cached_tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    return handle;
+}
+
+int mcontainer_queue_close(int devfd, struct mcontainer_queue *queue)
+{
+    int ret = mcontainer_unmap(devfd, queue->q, queue->size);
+
+    free(queue);
+    return ret;
+}
+
+static int spsc_push(struct mcontainer_queue *queue, const void *msg)
+{
+    struct queue_shared *q = queue->q;
+    __u64 head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+    if (head - queue->cached_tail >= q->capacity)
+    {
+        queue->cached_tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+        if (head - queue->cached_tail >= q->capacity)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+    memcpy(slot(q, head), msg, q->msg_size);
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int spsc_pop(struct mcontainer_queue *queue, void *msg)
+{
+    struct queue_shared *q = queue->q;
+    __u64 tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+
+    // the cached head is stale, not just behind, if other handles popped
+    if ((long long)(queue->cached_head - tail) <= 0)
+    {
+        queue->cached_head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        if (tail == queue->cached_head)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+    memcpy(msg, slot(q, tail), q->msg_size);
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int mpmc_push(struct mcontainer_queue *queue, const void *msg)
+{
+    struct queue_shared *q = queue->q;
+    __u64 pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED), seq;
+    char *s;
+
+    for (;;)
+    {
+        s = slot(q, pos);
+        seq = __atomic_load_n((__u64 *)s, __ATOMIC_ACQUIRE);
+        if (seq == pos)
+        {
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if ((long long)(seq - pos) < 0)
+        {
+            // the consumer of the previous lap has not freed the slot
+            errno = EAGAIN;
+            return -1;
+        }
+        else
+        {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+    memcpy(s + sizeof(__u64), msg, q->msg_size);
+    __atomic_store_n((__u64 *)s, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int mpmc_pop(struct mcontainer_queue *queue, void *msg)
+{
+    struct queue_shared *q = queue->q;
+    __u64 pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED), seq;
+    char *s;
+
+    for (;;)
+    {
+        s = slot(q, pos);
+        seq = __atomic_load_n((__u64 *)s, __ATOMIC_ACQUIRE);
+        if (seq == pos + 1)
+        {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if ((long long)(seq - (pos + 1)) < 0)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        else
+        {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+    memcpy(msg, s + sizeof(__u64), q->msg_size);
+    __atomic_store_n((__u64 *)s, pos + q->capacity, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Copy one message of msg_size bytes in. Returns -1 with EAGAIN when the
+ * queue is full. An SPSC queue must have one pushing thread at a time.
+ */
+int mcontainer_queue_push(struct mcontainer_queue *queue, const void *msg)
+{
+    if (queue->q->flags == MCONTAINER_QUEUE_SPSC)
+    {
+        return spsc_push(queue, msg);
+    }
+    return mpmc_push(queue, msg);
+}
+
+/**
+ * Copy the oldest message out. Returns -1 with EAGAIN when the queue is
+ * empty. An SPSC queue must have one popping thread at a time.
+ */
+int mcontainer_queue_pop(struct mcontainer_queue *queue, void *msg)
+{
+    if (queue->q->flags == MCONTAINER_QUEUE_SPSC)
+    {
+        return spsc_pop(queue, msg);
+    }
+    return mpmc_pop(queue, msg);
+}
@@ -0,0 +1,1336 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Description:
+//     User-Space Emulation Backend of Memory Container
+//
+//     Objects live in a shared-memory data file and are described by a
+//     registry (another shared-memory file) that every process opening
+//     the backend maps. Object locks are futexes inside the registry, so
+//     an uncontended lock/unlock never enters the kernel; a lock whose
+//     holder died is taken over by its next waiter, as in the module.
+//     Membership is per thread, like the kernel module's per-task
+//     membership.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "mcontainer_user.h"
+
+#include <memory_container/memory_container.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#define USER_MAGIC          0x4d434f33U /* "MCO3" */
+#define USER_DEFAULT_NAME   "/mcontainer"
+#define USER_DEFAULT_SLOTS  (1U << 20)
+#define USER_WINDOW         (1ULL << 40)
+
+enum
+{
+    SLOT_EMPTY = 0,
+    SLOT_USED,
+};
+
+struct user_object
+{
+    __u64 cid;
+    __u64 oid;
+    __u32 state;
+    __u32 lock;     // futex: 0 unlocked, else holder tid | FUTEX_WAITERS
+    __u64 offset;   // byte offset of the backing in the data file
+    __u64 size;     // 0 while the object has no backing
+    __u64 capacity; // extent reserved at offset, kept across free
+    __u64 seq;      // writers inside / version, as the module's counters
+};
+
+struct user_registry
+{
+    __u32 magic;
+    __u32 lock;     // futex protecting slot insertion and the allocator
+    __u32 slots;    // power of two
+    __u32 pad;
+    __u64 data_end;
+    struct user_object objects[];
+};
+
+static struct user_registry *registry = NULL;
+static int registry_fd = -1;
+static int data_fd = -1;
+static char *window = NULL;
+static __thread long long current_cid = -1;
+
+// fds from mcontainer_user_bind(): cid + 1 of the bound container, 0 if unbound
+#define USER_MAX_FDS 1024
+static long long bound_cid[USER_MAX_FDS];
+
+#define FUTEX_SPINS 128
+// waiters check this often whether the holder died without unlocking
+#define FUTEX_CHECK_NS 100000000LL
+
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+static long sys_futex(__u32 *uaddr, int op, __u32 val, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+static __u64 monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static __thread __u32 tid_cache;
+
+static __u32 thread_tid(void)
+{
+    if (!tid_cache)
+    {
+        tid_cache = syscall(SYS_gettid);
+    }
+    return tid_cache;
+}
+
+// the forking thread goes on in the child under a new tid
+static void forget_tid(void)
+{
+    tid_cache = 0;
+}
+
+// a holder that is gone can no longer unlock
+static int holder_died(__u32 c)
+{
+    __u32 tid = c & FUTEX_TID_MASK;
+
+    return tid && kill(tid, 0) < 0 && errno == ESRCH;
+}
+
+/**
+ * futex mutex holding the tid of its holder; only the contended path makes
+ * a system call. A short spin comes first since holders usually release
+ * quickly. A negative timeout waits forever, 0 only tries. Returns 0, or
+ * EOWNERDEAD if the lock was taken over from a holder that died in it, or
+ * an errno: EDEADLK if the caller holds it already, like the kernel.
+ */
+static int futex_lock_timeout(__u32 *word, long long timeout_ns)
+{
+    struct timespec ts;
+    __u64 deadline = 0, now;
+    long long wait_ns;
+    __u32 tid = thread_tid(), c = 0;
+    int i;
+
+    if (__atomic_compare_exchange_n(word, &c, tid, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        return 0;
+    }
+    if ((c & FUTEX_TID_MASK) == tid)
+    {
+        return EDEADLK;
+    }
+    if (timeout_ns == 0)
+    {
+        return holder_died(c) && __atomic_compare_exchange_n(word, &c, tid, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)
+                   ? EOWNERDEAD
+                   : EBUSY;
+    }
+    for (i = 0; i < FUTEX_SPINS && !(c & FUTEX_WAITERS); i++)
+    {
+        cpu_relax();
+        c = 0;
+        if (__atomic_compare_exchange_n(word, &c, tid, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            return 0;
+        }
+    }
+    if (timeout_ns > 0)
+    {
+        deadline = monotonic_ns() + timeout_ns;
+    }
+    for (;;)
+    {
+        c = __atomic_load_n(word, __ATOMIC_RELAXED);
+        // others may be waiting too, so a lock taken here keeps the bit
+        if (c == 0)
+        {
+            if (__atomic_compare_exchange_n(word, &c, tid | FUTEX_WAITERS, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            {
+                return 0;
+            }
+            continue;
+        }
+        if (holder_died(c))
+        {
+            if (__atomic_compare_exchange_n(word, &c, tid | FUTEX_WAITERS, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            {
+                return EOWNERDEAD;
+            }
+            continue;
+        }
+        if (!(c & FUTEX_WAITERS) &&
+            !__atomic_compare_exchange_n(word, &c, c | FUTEX_WAITERS, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            continue;
+        }
+        wait_ns = FUTEX_CHECK_NS;
+        if (timeout_ns > 0)
+        {
+            now = monotonic_ns();
+            if (now >= deadline)
+            {
+                return ETIMEDOUT;
+            }
+            if ((long long)(deadline - now) < wait_ns)
+            {
+                wait_ns = deadline - now;
+            }
+        }
+        ts.tv_sec = wait_ns / 1000000000LL;
+        ts.tv_nsec = wait_ns % 1000000000LL;
+        sys_futex(word, FUTEX_WAIT, c | FUTEX_WAITERS, &ts);
+    }
+}
+
+static void futex_lock(__u32 *word)
+{
+    futex_lock_timeout(word, -1);
+}
+
+static void futex_unlock(__u32 *word)
+{
+    if (__atomic_exchange_n(word, 0, __ATOMIC_RELEASE) & FUTEX_WAITERS)
+    {
+        sys_futex(word, FUTEX_WAKE, 1, NULL);
+    }
+}
+
+static __u64 slot_hash(__u64 cid, __u64 oid)
+{
+    __u64 h = cid * 0x9E3779B97F4A7C15ULL ^ oid;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * Find the registry slot of (cid, oid). Slots are never released once
+ * used, so lookups of existing objects need no lock; insertion re-probes
+ * under the registry lock.
+ */
+static struct user_object *get_object(__u64 cid, __u64 oid, int create)
+{
+    __u32 mask = registry->slots - 1, i, n;
+    struct user_object *obj;
+
+    for (n = 0, i = slot_hash(cid, oid) & mask; n <= mask; n++, i = (i + 1) & mask)
+    {
+        obj = &registry->objects[i];
+        if (__atomic_load_n(&obj->state, __ATOMIC_ACQUIRE) == SLOT_EMPTY)
+        {
+            break;
+        }
+        if (obj->cid == cid && obj->oid == oid)
+        {
+            return obj;
+        }
+    }
+    if (!create)
+    {
+        return NULL;
+    }
+
+    futex_lock(&registry->lock);
+    for (n = 0, i = slot_hash(cid, oid) & mask; n <= mask; n++, i = (i + 1) & mask)
+    {
+        obj = &registry->objects[i];
+        if (obj->state == SLOT_EMPTY)
+        {
+            obj->cid = cid;
+            obj->oid = oid;
+            obj->lock = 0;
+            obj->offset = 0;
+            obj->size = 0;
+            obj->capacity = 0;
+            obj->seq = 0;
+            __atomic_store_n(&obj->state, SLOT_USED, __ATOMIC_RELEASE);
+            futex_unlock(&registry->lock);
+            return obj;
+        }
+        if (obj->cid == cid && obj->oid == oid)
+        {
+            futex_unlock(&registry->lock);
+            return obj;
+        }
+    }
+    futex_unlock(&registry->lock);
+    errno = ENOSPC;
+    return NULL;
+}
+
+static int open_shared(const char *name, const char *suffix)
+{
+    char path[NAME_MAX];
+
+    snprintf(path, sizeof(path), "%s%s", name, suffix);
+    return shm_open(path, O_RDWR | O_CREAT, 0666);
+}
+
+/**
+ * Open (creating on first use) the shared registry named by
+ * MCONTAINER_REGISTRY. The returned descriptor stands in for the device
+ * file; fast mode additionally maps the whole data file once so that
+ * mcontainer_alloc() needs no system call.
+ */
+int mcontainer_user_open(int fast)
+{
+    const char *name = getenv("MCONTAINER_REGISTRY");
+    const char *slots_env = getenv("MCONTAINER_USER_SLOTS");
+    __u32 slots = USER_DEFAULT_SLOTS;
+    size_t registry_size;
+    struct stat st;
+
+    if (registry)
+    {
+        return registry_fd;
+    }
+    if (!name)
+    {
+        name = USER_DEFAULT_NAME;
+    }
+    if (slots_env)
+    {
+        slots = strtoul(slots_env, NULL, 0);
+        while (slots & (slots - 1))
+        {
+            slots &= slots - 1;
+        }
+        if (!slots)
+        {
+            slots = USER_DEFAULT_SLOTS;
+        }
+    }
+
+    registry_fd = open_shared(name, "");
+    data_fd = open_shared(name, ".data");
+    if (registry_fd < 0 || data_fd < 0)
+    {
+        goto fail;
+    }
+
+    // the first process to take the file lock initializes the registry.
+    flock(registry_fd, LOCK_EX);
+    if (fstat(registry_fd, &st) < 0)
+    {
+        flock(registry_fd, LOCK_UN);
+        goto fail;
+    }
+    if (st.st_size == 0)
+    {
+        registry_size = sizeof(struct user_registry) + (size_t)slots * sizeof(struct user_object);
+        if (ftruncate(registry_fd, registry_size) < 0)
+        {
+            flock(registry_fd, LOCK_UN);
+            goto fail;
+        }
+    }
+    else
+    {
+        registry_size = st.st_size;
+    }
+    registry = mmap(0, registry_size, PROT_READ | PROT_WRITE, MAP_SHARED, registry_fd, 0);
+    if (registry == MAP_FAILED)
+    {
+        registry = NULL;
+        flock(registry_fd, LOCK_UN);
+        goto fail;
+    }
+    if (registry->magic != USER_MAGIC)
+    {
+        registry->slots = slots;
+        registry->data_end = 0;
+        __atomic_store_n(&registry->magic, USER_MAGIC, __ATOMIC_RELEASE);
+    }
+    flock(registry_fd, LOCK_UN);
+
+    if (fast)
+    {
+        window = mmap(0, USER_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, data_fd, 0);
+        if (window == MAP_FAILED)
+        {
+            window = NULL;
+        }
+    }
+    pthread_atfork(NULL, NULL, forget_tid);
+    return registry_fd;
+
+fail:
+    if (registry_fd >= 0)
+    {
+        close(registry_fd);
+    }
+    if (data_fd >= 0)
+    {
+        close(data_fd);
+    }
+    registry_fd = data_fd = -1;
+    return -1;
+}
+
+int mcontainer_user_owns(int devfd)
+{
+    return registry && (devfd == registry_fd ||
+                        (devfd >= 0 && devfd < USER_MAX_FDS && bound_cid[devfd]));
+}
+
+/**
+ * container devfd works on: the calling thread's for the shared registry
+ * fd, the bound one for an fd from mcontainer_user_bind().
+ */
+static long long fd_cid(int devfd)
+{
+    return devfd == registry_fd ? current_cid : bound_cid[devfd] - 1;
+}
+
+// the calling thread joined cid or holds an fd bound to it
+static int is_member(__u64 cid)
+{
+    int fd;
+
+    if (current_cid >= 0 && (__u64)current_cid == cid)
+    {
+        return 1;
+    }
+    for (fd = 0; fd < USER_MAX_FDS; fd++)
+    {
+        if (bound_cid[fd] && (__u64)(bound_cid[fd] - 1) == cid)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int mcontainer_user_delete(int devfd)
+{
+    (void)devfd;
+    current_cid = -1;
+    return 0;
+}
+
+int mcontainer_user_create(int devfd, int cid)
+{
+    (void)devfd;
+    current_cid = cid;
+    return 0;
+}
+
+/**
+ * a handle of its own on the registry, bound to cid. Any number of them
+ * can be open in one thread next to the shared fd of mcontainer_init().
+ */
+int mcontainer_user_bind(int cid)
+{
+    int fd;
+
+    if (!registry || cid < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    fd = dup(registry_fd);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (fd >= USER_MAX_FDS)
+    {
+        close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+    __atomic_store_n(&bound_cid[fd], (long long)cid + 1, __ATOMIC_RELEASE);
+    return fd;
+}
+
+int mcontainer_user_unbind(int devfd)
+{
+    if (devfd == registry_fd)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    __atomic_store_n(&bound_cid[devfd], 0, __ATOMIC_RELEASE);
+    return close(devfd);
+}
+
+/**
+ * Carve the backing of an object out of the data file the first time it
+ * is allocated. As in the kernel module, the first allocation fixes the
+ * object size.
+ */
+static int reserve_backing(struct user_object *obj, __u64 aligned_size)
+{
+    struct stat st;
+
+    if (__atomic_load_n(&obj->size, __ATOMIC_ACQUIRE) != 0)
+    {
+        return 0;
+    }
+    futex_lock(&registry->lock);
+    if (obj->size == 0 && aligned_size > obj->capacity)
+    {
+        obj->offset = registry->data_end;
+        registry->data_end += aligned_size;
+        if (fstat(data_fd, &st) == 0 && (__u64)st.st_size < registry->data_end &&
+            ftruncate(data_fd, registry->data_end) < 0)
+        {
+            registry->data_end -= aligned_size;
+            futex_unlock(&registry->lock);
+            return -1;
+        }
+        obj->capacity = aligned_size;
+    }
+    if (obj->size == 0)
+    {
+        __atomic_store_n(&obj->size, aligned_size, __ATOMIC_RELEASE);
+    }
+    futex_unlock(&registry->lock);
+    return 0;
+}
+
+static __u64 page_align(__u64 size)
+{
+    __u64 page = getpagesize();
+    return ((size + page - 1) / page) * page;
+}
+
+/**
+ * Map the object, creating it on first use.
+ */
+void *mcontainer_user_alloc(int devfd, __u64 offset, __u64 size, void *addr)
+{
+    __u64 aligned_size = page_align(size);
+    struct user_object *obj;
+
+    if (fd_cid(devfd) < 0)
+    {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    obj = get_object(fd_cid(devfd), offset, 1);
+    if (!obj || reserve_backing(obj, aligned_size) < 0)
+    {
+        return MAP_FAILED;
+    }
+    if (aligned_size > obj->size)
+    {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    if (addr)
+    {
+        return mmap(addr, aligned_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, data_fd, obj->offset);
+    }
+    if (window && obj->offset + aligned_size <= USER_WINDOW)
+    {
+        return window + obj->offset;
+    }
+    return mmap(0, aligned_size, PROT_READ | PROT_WRITE, MAP_SHARED, data_fd, obj->offset);
+}
+
+int mcontainer_user_unmap(void *addr, __u64 size)
+{
+    if (window && (char *)addr >= window && (char *)addr < window + USER_WINDOW)
+    {
+        return 0;
+    }
+    return munmap(addr, size);
+}
+
+/**
+ * Reserve and populate the backing of a range of objects. There is no
+ * worker in user space; fallocate() makes the pages resident up front so
+ * the first touch after mcontainer_alloc() does not fault them in.
+ */
+int mcontainer_user_prefetch(int devfd, __u64 offset, __u64 count, __u64 size)
+{
+    __u64 aligned_size = page_align(size), oid;
+    struct user_object *obj;
+
+    if (fd_cid(devfd) < 0 || count == 0 || offset + count < offset || offset + count > MCONTAINER_SLAB_OID)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for (oid = offset; oid < offset + count; oid++)
+    {
+        obj = get_object(fd_cid(devfd), oid, 1);
+        if (!obj || reserve_backing(obj, aligned_size) < 0)
+        {
+            return -1;
+        }
+        fallocate(data_fd, FALLOC_FL_KEEP_SIZE, obj->offset, obj->size);
+    }
+    return 0;
+}
+
+/**
+ * Object lock plus its sequence counter: holding the lock counts as one
+ * writer inside, releasing it bumps the version. Taking over the lock of
+ * a dead holder ends that holder's write first.
+ */
+static int object_lock(struct user_object *obj, long long timeout_ns)
+{
+    int err = futex_lock_timeout(&obj->lock, timeout_ns);
+
+    if (err == EOWNERDEAD)
+    {
+        __atomic_fetch_add(&obj->seq, MCONTAINER_SEQ_WRITERS, __ATOMIC_SEQ_CST);
+        err = 0;
+    }
+    if (err == 0)
+    {
+        __atomic_fetch_add(&obj->seq, 1, __ATOMIC_SEQ_CST);
+    }
+    return err;
+}
+
+/**
+ * Only the holder may unlock, or the writer count would go below zero.
+ * Returns 0 or EPERM, like the kernel.
+ */
+static int object_unlock(struct user_object *obj)
+{
+    if ((__atomic_load_n(&obj->lock, __ATOMIC_RELAXED) & FUTEX_TID_MASK) != thread_tid())
+    {
+        return EPERM;
+    }
+    __atomic_fetch_add(&obj->seq, MCONTAINER_SEQ_WRITERS, __ATOMIC_SEQ_CST);
+    futex_unlock(&obj->lock);
+    return 0;
+}
+
+int mcontainer_user_read_begin(int devfd, __u64 offset, __u64 *seq)
+{
+    struct user_object *obj;
+
+    if (fd_cid(devfd) < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    obj = get_object(fd_cid(devfd), offset, 1);
+    if (!obj)
+    {
+        return -1;
+    }
+    while ((*seq = __atomic_load_n(&obj->seq, __ATOMIC_ACQUIRE)) & MCONTAINER_SEQ_WRITERS)
+    {
+        cpu_relax();
+    }
+    return 0;
+}
+
+int mcontainer_user_read_retry(int devfd, __u64 offset, __u64 seq)
+{
+    struct user_object *obj;
+
+    obj = fd_cid(devfd) < 0 ? NULL : get_object(fd_cid(devfd), offset, 0);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return !obj || __atomic_load_n(&obj->seq, __ATOMIC_RELAXED) != seq;
+}
+
+int mcontainer_user_lock(int devfd, __u64 offset, long long timeout_ns)
+{
+    struct user_object *obj;
+    int err;
+
+    if (fd_cid(devfd) < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    obj = get_object(fd_cid(devfd), offset, 1);
+    if (!obj)
+    {
+        return -1;
+    }
+    err = object_lock(obj, timeout_ns);
+    if (err)
+    {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int mcontainer_user_unlock(int devfd, __u64 offset)
+{
+    struct user_object *obj;
+    int err;
+
+    if (fd_cid(devfd) < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    obj = get_object(fd_cid(devfd), offset, 0);
+    if (!obj)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    err = object_unlock(obj);
+    if (err)
+    {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static int compare_oid(const void *a, const void *b)
+{
+    __u64 x = *(const __u64 *)a, y = *(const __u64 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * sorted copy of an oid array without duplicates; *m gets its length
+ */
+static __u64 *sort_oids(const __u64 *oids, __u64 n, __u64 *m)
+{
+    __u64 *sorted, i;
+
+    sorted = malloc((n ? n : 1) * sizeof(*sorted));
+    if (!sorted)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memcpy(sorted, oids, n * sizeof(*sorted));
+    qsort(sorted, n, sizeof(*sorted), compare_oid);
+    for (*m = 0, i = 0; i < n; i++)
+    {
+        if (*m == 0 || sorted[*m - 1] != sorted[i])
+        {
+            sorted[(*m)++] = sorted[i];
+        }
+    }
+    return sorted;
+}
+
+/**
+ * Lock several objects in ascending oid order; on failure the locks
+ * already taken are released again.
+ */
+int mcontainer_user_lock_many(int devfd, const __u64 *oids, __u64 n, long long timeout_ns)
+{
+    struct user_object *obj;
+    __u64 *sorted, i, m;
+    __u64 deadline = timeout_ns > 0 ? monotonic_ns() + timeout_ns : 0, now;
+    int err = 0;
+
+    if (fd_cid(devfd) < 0 || n == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    sorted = sort_oids(oids, n, &m);
+    if (!sorted)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < m && err == 0; i++)
+    {
+        obj = get_object(fd_cid(devfd), sorted[i], 1);
+        if (!obj)
+        {
+            err = errno;
+        }
+        else if (timeout_ns > 0)
+        {
+            now = monotonic_ns();
+            err = object_lock(obj, deadline > now ? (long long)(deadline - now) : 1);
+        }
+        else
+        {
+            err = object_lock(obj, timeout_ns);
+        }
+    }
+    if (err)
+    {
+        //sorted[i - 1] failed, everything before it is held
+        for (i--; i > 0; i--)
+        {
+            object_unlock(get_object(fd_cid(devfd), sorted[i - 1], 0));
+        }
+    }
+    free(sorted);
+    if (err)
+    {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int mcontainer_user_unlock_many(int devfd, const __u64 *oids, __u64 n)
+{
+    __u64 *sorted, i, m;
+    int ret = 0;
+
+    sorted = sort_oids(oids, n, &m);
+    if (!sorted)
+    {
+        return -1;
+    }
+    for (i = 0; i < m; i++)
+    {
+        if (mcontainer_user_unlock(devfd, sorted[i]) < 0)
+        {
+            ret = -1;
+        }
+    }
+    free(sorted);
+    return ret;
+}
+
+/**
+ * Release the backing of an object. The slot (and its lock) stays and
+ * its extent is kept for reuse; the next allocation sees zeroed pages.
+ */
+int mcontainer_user_free(int devfd, __u64 offset)
+{
+    struct user_object *obj;
+
+    if (fd_cid(devfd) < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    obj = get_object(fd_cid(devfd), offset, 0);
+    if (!obj)
+    {
+        return 0;
+    }
+    futex_lock(&registry->lock);
+    if (obj->size)
+    {
+        fallocate(data_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, obj->offset, obj->size);
+        __atomic_store_n(&obj->size, 0, __ATOMIC_RELEASE);
+    }
+    futex_unlock(&registry->lock);
+    return 0;
+}
+
+/**
+ * Swap the extents of the two slots, so the target takes over the data and
+ * the source keeps what the target had reserved. Existing mappings of the
+ * data file cannot be revoked: they keep reaching the data until unmapped.
+ */
+int mcontainer_user_move(int devfd, __u64 offset, __u64 dst_cid, __u64 dst_offset)
+{
+    struct user_object *obj, *dst;
+    __u64 dst_extent, dst_capacity;
+    int ret = 0;
+
+    if (fd_cid(devfd) < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!is_member(dst_cid))
+    {
+        errno = EPERM;
+        return -1;
+    }
+    obj = get_object(fd_cid(devfd), offset, 0);
+    if (!obj)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    dst = get_object(dst_cid, dst_offset, 1);
+    if (!dst)
+    {
+        return -1;
+    }
+    if (dst == obj)
+    {
+        return 0;
+    }
+    // the object lock is held across the move, like a writer's
+    if (object_lock(obj, 0))
+    {
+        errno = EBUSY;
+        return -1;
+    }
+    futex_lock(&registry->lock);
+    if (dst->size != 0)
+    {
+        errno = EEXIST;
+        ret = -1;
+    }
+    else
+    {
+        dst_extent = dst->offset;
+        dst_capacity = dst->capacity;
+        dst->offset = obj->offset;
+        dst->capacity = obj->capacity;
+        __atomic_store_n(&dst->size, obj->size, __ATOMIC_RELEASE);
+        __atomic_store_n(&obj->size, 0, __ATOMIC_RELEASE);
+        obj->offset = dst_extent;
+        obj->capacity = dst_capacity;
+    }
+    futex_unlock(&registry->lock);
+    object_unlock(obj);
+    return ret;
+}
+
+/**
+ * Copy size bytes of object data between two page-aligned extents.
+ */
+static int copy_data(__u64 from_offset, __u64 to_offset, __u64 size)
+{
+    char *from, *to;
+    int ret = -1;
+
+    from = mmap(0, size, PROT_READ, MAP_SHARED, data_fd, from_offset);
+    to = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, data_fd, to_offset);
+    if (from != MAP_FAILED && to != MAP_FAILED)
+    {
+        memcpy(to, from, size);
+        ret = 0;
+    }
+    if (from != MAP_FAILED)
+    {
+        munmap(from, size);
+    }
+    if (to != MAP_FAILED)
+    {
+        munmap(to, size);
+    }
+    return ret;
+}
+
+/**
+ * Resize an object. Within the extent reserved for it this happens in
+ * place; growing past the extent moves the data to a new extent, which
+ * existing mappers pick up through mcontainer_remap().
+ */
+int mcontainer_user_resize(int devfd, __u64 offset, __u64 size)
+{
+    __u64 aligned_size = page_align(size), new_offset;
+    struct user_object *obj;
+    struct stat st;
+
+    if (fd_cid(devfd) < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    obj = get_object(fd_cid(devfd), offset, 1);
+    if (!obj)
+    {
+        return -1;
+    }
+
+    futex_lock(&registry->lock);
+    if (aligned_size <= obj->capacity)
+    {
+        if (aligned_size < obj->size)
+        {
+            fallocate(data_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, obj->offset + aligned_size,
+                      obj->size - aligned_size);
+        }
+        __atomic_store_n(&obj->size, aligned_size, __ATOMIC_RELEASE);
+        futex_unlock(&registry->lock);
+        return 0;
+    }
+
+    new_offset = registry->data_end;
+    if (fstat(data_fd, &st) < 0 ||
+        ((__u64)st.st_size < new_offset + aligned_size && ftruncate(data_fd, new_offset + aligned_size) < 0))
+    {
+        futex_unlock(&registry->lock);
+        return -1;
+    }
+    registry->data_end += aligned_size;
+    if (obj->size)
+    {
+        copy_data(obj->offset, new_offset, obj->size);
+    }
+    if (obj->capacity)
+    {
+        fallocate(data_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, obj->offset, obj->capacity);
+    }
+    obj->offset = new_offset;
+    obj->capacity = aligned_size;
+    __atomic_store_n(&obj->size, aligned_size, __ATOMIC_RELEASE);
+    futex_unlock(&registry->lock);
+    return 0;
+}
+
+void *mcontainer_user_remap(int devfd, __u64 offset, void *addr, __u64 old_size, __u64 new_size)
+{
+    if (!window || (char *)addr < window || (char *)addr >= window + USER_WINDOW)
+    {
+        munmap(addr, old_size);
+    }
+    return mcontainer_user_alloc(devfd, offset, new_size, NULL);
+}
+
+/**
+ * Import an existing buffer (ptr) or the head of a file (fd). The data
+ * file cannot take over foreign pages, so unlike the kernel module this
+ * copies the data into a new object.
+ */
+int mcontainer_user_import(int devfd, __u64 offset, const void *ptr, int fd, __u64 size)
+{
+    __u64 aligned_size = page_align(size);
+    struct user_object *obj;
+    char *dst;
+    ssize_t n = 0;
+
+    if (fd_cid(devfd) < 0 || aligned_size == 0 || offset >= MCONTAINER_SLAB_OID)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    obj = get_object(fd_cid(devfd), offset, 1);
+    if (!obj)
+    {
+        return -1;
+    }
+    if (__atomic_load_n(&obj->size, __ATOMIC_ACQUIRE) != 0)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+    dst = mcontainer_user_alloc(devfd, offset, size, NULL);
+    if (dst == MAP_FAILED)
+    {
+        return -1;
+    }
+    if (ptr)
+    {
+        memcpy(dst, ptr, size);
+    }
+    else
+    {
+        n = pread(fd, dst, size, 0);
+    }
+    if (!window || dst < window || dst >= window + USER_WINDOW)
+    {
+        munmap(dst, aligned_size);
+    }
+    return n < 0 ? -1 : 0;
+}
+
+// copying one object of the snapshot source, its lock held
+static int snapshot_object(struct user_object *src, __u64 dst_cid)
+{
+    struct user_object *dst;
+
+    if (src->size == 0)
+    {
+        return 0;
+    }
+    dst = get_object(dst_cid, src->oid, 1);
+    if (!dst || dst->size != 0)
+    {
+        if (dst)
+        {
+            errno = EEXIST;
+        }
+        return -1;
+    }
+    if (reserve_backing(dst, src->size) < 0 || copy_data(src->offset, dst->offset, src->size) < 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Copy every object of container src_cid, which the caller has to be a
+ * member of, into dst_cid. The data file has no way to share extents
+ * between objects, so this is a full copy rather than copy-on-write; it is
+ * still consistent as long as writers of src_cid hold the object locks,
+ * which are taken around each copy unless the caller holds them already.
+ */
+int mcontainer_user_snapshot(int devfd, __u64 src_cid, __u64 dst_cid)
+{
+    struct user_object *src;
+    __u32 i;
+    int held, ret;
+
+    (void)devfd;
+    if (src_cid == dst_cid)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+    if (!is_member(src_cid))
+    {
+        errno = EPERM;
+        return -1;
+    }
+    for (i = 0; i < registry->slots; i++)
+    {
+        src = &registry->objects[i];
+        if (__atomic_load_n(&src->state, __ATOMIC_ACQUIRE) != SLOT_USED || src->cid != src_cid)
+        {
+            continue;
+        }
+        held = object_lock(src, -1) == EDEADLK;
+        ret = snapshot_object(src, dst_cid);
+        if (!held)
+        {
+            object_unlock(src);
+        }
+        if (ret < 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Write every object of the current container to fd in the module's
+ * checkpoint format, so checkpoints move freely between the backends.
+ */
+int mcontainer_user_checkpoint(int devfd, int fd)
+{
+    struct mcontainer_checkpoint_header header;
+    struct mcontainer_checkpoint_entry *entries;
+    struct user_object *obj;
+    __u64 count = 0, n = 0, pos;
+    __u32 i;
+    char *data;
+    int ret = 0;
+
+    if (fd_cid(devfd) < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < registry->slots; i++)
+    {
+        obj = &registry->objects[i];
+        if (__atomic_load_n(&obj->state, __ATOMIC_ACQUIRE) == SLOT_USED && obj->cid == (__u64)fd_cid(devfd))
+        {
+            count++;
+        }
+    }
+    entries = calloc(count ? count : 1, sizeof(*entries));
+    if (!entries)
+    {
+        return -1;
+    }
+
+    pos = page_align(sizeof(header) + count * sizeof(*entries));
+    for (i = 0; i < registry->slots && n < count && ret == 0; i++)
+    {
+        obj = &registry->objects[i];
+        if (__atomic_load_n(&obj->state, __ATOMIC_ACQUIRE) != SLOT_USED || obj->cid != (__u64)fd_cid(devfd))
+        {
+            continue;
+        }
+        entries[n].oid = obj->oid;
+        entries[n].npages = obj->size / getpagesize();
+        entries[n].offset = pos;
+        if (obj->size)
+        {
+            data = mmap(0, obj->size, PROT_READ, MAP_SHARED, data_fd, obj->offset);
+            if (data == MAP_FAILED || pwrite(fd, data, obj->size, pos) != (ssize_t)obj->size)
+            {
+                ret = -1;
+            }
+            if (data != MAP_FAILED)
+            {
+                munmap(data, obj->size);
+            }
+        }
+        pos += obj->size;
+        n++;
+    }
+
+    header.magic = MCONTAINER_CHECKPOINT_MAGIC;
+    header.count = n;
+    if (ret == 0 && (pwrite(fd, &header, sizeof(header), 0) != sizeof(header) ||
+                     pwrite(fd, entries, n * sizeof(*entries), sizeof(header)) != (ssize_t)(n * sizeof(*entries))))
+    {
+        ret = -1;
+    }
+    free(entries);
+    return ret;
+}
+
+/**
+ * Recreate the objects of a checkpoint in the current container. The data
+ * file cannot fault pages in from another file, so they are read eagerly.
+ */
+int mcontainer_user_restore(int devfd, int fd)
+{
+    struct mcontainer_checkpoint_header header;
+    struct mcontainer_checkpoint_entry entry;
+    struct user_object *obj;
+    __u64 i, size;
+    char *data;
+    int ret = 0;
+
+    if (fd_cid(devfd) < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != MCONTAINER_CHECKPOINT_MAGIC)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < header.count && ret == 0; i++)
+    {
+        if (pread(fd, &entry, sizeof(entry), sizeof(header) + i * sizeof(entry)) != sizeof(entry))
+        {
+            errno = EIO;
+            return -1;
+        }
+        size = entry.npages * getpagesize();
+        obj = get_object(fd_cid(devfd), entry.oid, 1);
+        if (!obj)
+        {
+            return -1;
+        }
+        if (obj->size != 0)
+        {
+            errno = EEXIST;
+            return -1;
+        }
+        if (size == 0)
+        {
+            continue;
+        }
+        if (reserve_backing(obj, size) < 0)
+        {
+            return -1;
+        }
+        data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, data_fd, obj->offset);
+        if (data == MAP_FAILED)
+        {
+            return -1;
+        }
+        if (pread(fd, data, size, entry.offset) != (ssize_t)size)
+        {
+            errno = EIO;
+            ret = -1;
+        }
+        munmap(data, size);
+    }
+    return ret;
+}
+
+/**
+ * Writes to the shared data file cannot be observed, so every page of an
+ * object is reported dirty; a sync stays correct, just not incremental.
+ */
+int mcontainer_user_collect_dirty(int devfd, __u64 offset, __u64 *bitmap, __u64 npages)
+{
+    struct user_object *obj;
+    __u64 pages, i;
+
+    if (fd_cid(devfd) < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    obj = get_object(fd_cid(devfd), offset, 0);
+    if (!obj)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    pages = __atomic_load_n(&obj->size, __ATOMIC_ACQUIRE) / getpagesize();
+    for (i = 0; i < (npages < pages ? npages : pages); i++)
+    {
+        if (i % 64 == 0)
+        {
+            bitmap[i / 64] = 0;
+        }
+        bitmap[i / 64] |= 1ULL << (i % 64);
+    }
+    return pages;
+}
+
+/**
+ * Objects of a container never share backing in the data file, so nothing
+ * is ever saved by dedup here.
+ */
+int mcontainer_user_stats(int devfd, struct mcontainer_stats *stats)
+{
+    struct user_object *obj;
+    __u32 i;
+
+    if (fd_cid(devfd) < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < registry->slots; i++)
+    {
+        obj = &registry->objects[i];
+        if (__atomic_load_n(&obj->state, __ATOMIC_ACQUIRE) == SLOT_USED && obj->cid == (__u64)fd_cid(devfd) &&
+            __atomic_load_n(&obj->size, __ATOMIC_ACQUIRE))
+        {
+            stats->objects++;
+            stats->bytes += __atomic_load_n(&obj->size, __ATOMIC_ACQUIRE);
+        }
+    }
+    return 0;
+}
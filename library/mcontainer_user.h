@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Description:
+//     User-Space Emulation Backend of Memory Container (library internal)
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef MCONTAINER_USER_H
+#define MCONTAINER_USER_H
+
+#include <linux/types.h>
+
+struct mcontainer_stats;
+
+int mcontainer_user_open(int fast);
+int mcontainer_user_owns(int devfd);
+int mcontainer_user_delete(int devfd);
+int mcontainer_user_create(int devfd, int cid);
+int mcontainer_user_bind(int cid);
+int mcontainer_user_unbind(int devfd);
+void *mcontainer_user_alloc(int devfd, __u64 offset, __u64 size, void *addr);
+int mcontainer_user_unmap(void *addr, __u64 size);
+int mcontainer_user_lock(int devfd, __u64 offset, long long timeout_ns);
+int mcontainer_user_unlock(int devfd, __u64 offset);
+int mcontainer_user_read_begin(int devfd, __u64 offset, __u64 *seq);
+int mcontainer_user_read_retry(int devfd, __u64 offset, __u64 seq);
+int mcontainer_user_lock_many(int devfd, const __u64 *oids, __u64 n, long long timeout_ns);
+int mcontainer_user_unlock_many(int devfd, const __u64 *oids, __u64 n);
+int mcontainer_user_free(int devfd, __u64 offset);
+int mcontainer_user_move(int devfd, __u64 offset, __u64 dst_cid, __u64 dst_offset);
+int mcontainer_user_prefetch(int devfd, __u64 offset, __u64 count, __u64 size);
+int mcontainer_user_resize(int devfd, __u64 offset, __u64 size);
+void *mcontainer_user_remap(int devfd, __u64 offset, void *addr, __u64 old_size, __u64 new_size);
+int mcontainer_user_snapshot(int devfd, __u64 src_cid, __u64 dst_cid);
+int mcontainer_user_checkpoint(int devfd, int fd);
+int mcontainer_user_restore(int devfd, int fd);
+int mcontainer_user_collect_dirty(int devfd, __u64 offset, __u64 *bitmap, __u64 npages);
+int mcontainer_user_import(int devfd, __u64 offset, const void *ptr, int fd, __u64 size);
+int mcontainer_user_stats(int devfd, struct mcontainer_stats *stats);
+
+#endif
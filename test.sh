@@ -1,8 +1,8 @@
 #!/bin/bash
 
 # Parse input
-if [ $# -ne 4 ]; then
-    echo "Usage: $0 <# of objects> <max size of objects> <# of tasks> <# of containers>"
+if [ $# -lt 4 ]; then
+    echo "Usage: $0 <# of objects> <max size of objects> <# of tasks> <# of containers> [benchmark options]"
     exit
 fi
 
@@ -11,9 +11,13 @@ max_size_of_objects=$2
 number_of_processes=$3
 number_of_containers=$4
 
-sudo insmod kernel_module/memory_container.ko
-sudo chmod 777 /dev/mcontainer
-./benchmark/benchmark $1 $2 $3 $4
+# MCONTAINER_BACKEND=user runs everything in user space, without the module.
+if [ "${MCONTAINER_BACKEND:-kernel}" = "kernel" ]; then
+    # persistent: validate reads the containers after every benchmark task has left
+    sudo insmod kernel_module/memory_container.ko persistent=1
+    sudo chmod 777 /dev/mcontainer
+fi
+./benchmark/benchmark "${@:5}" $1 $2 $3 $4
 cat *.log > trace
 sort -n -k 4 trace > sorted_trace
 ./benchmark/validate $1 $2 $4 < sorted_trace
@@ -21,4 +25,8 @@ sort -n -k 4 trace > sorted_trace
 # if you want to see the log for debugging, comment out the following line.
 rm -f *.log trace sorted_trace
 
-sudo rmmod memory_container
\ No newline at end of file
+if [ "${MCONTAINER_BACKEND:-kernel}" = "kernel" ]; then
+    sudo rmmod memory_container
+else
+    rm -f /dev/shm/${MCONTAINER_REGISTRY:-/mcontainer} /dev/shm/${MCONTAINER_REGISTRY:-/mcontainer}.data
+fi
\ No newline at end of file